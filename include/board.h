@@ -29,6 +29,8 @@
 
 #ifndef __ASSEMBLY__
 #  include <stdint.h>
+#  include <stdbool.h>
+#  include <time.h>
 #endif
 
 /* Do not include STM32 H7 header files here */
@@ -328,6 +330,25 @@
 #define GPIO_USART3_RX   (GPIO_USART3_RX_3 | GPIO_SPEED_100MHz)  /* PD9 */
 #define GPIO_USART3_TX   (GPIO_USART3_TX_3 | GPIO_SPEED_100MHz)  /* PD8 */
 
+/* DMA channels *************************************************************/
+
+/* USART3 RX (GPS) uses circular DMA so NMEA bursts do not interrupt per
+ * byte.
+ */
+
+#define DMAMAP_USART3_RX DMAMAP_DMA12_USART3RX_0
+
+/* ADC2 scans battery and pyro channels into a circular DMA buffer */
+
+#define DMAMAP_ADC2      DMAMAP_DMA12_ADC2_0
+
+/* USART2 (RN2483) moves hex-encoded frames and replies by DMA. Like the
+ * others it is on DMA1, the only DMA controller the configurations enable.
+ */
+
+#define DMAMAP_USART2_RX DMAMAP_DMA12_USART2RX_0
+#define DMAMAP_USART2_TX DMAMAP_DMA12_USART2TX_0
+
 /* I2C1 on PB8 & PB9 */
 
 #define GPIO_I2C1_SCL   (GPIO_I2C1_SCL_2 | GPIO_SPEED_100MHz)  /* PB8 */
@@ -362,6 +383,10 @@
 
 #define GPIO_TIM1_CH3OUT GPIO_TIM1_CH3OUT_2
 
+/* GNSS PPS capture on PA0 */
+
+#define GPIO_TIM5_CH1IN  GPIO_TIM5_CH1IN_1
+
 
 /* SDMMC definitions ********************************************************/
 
@@ -379,6 +404,221 @@
 
 #define STM32_SDMMC_CLKCR_EDGE      STM32_SDMMC_CLKCR_NEGEDGE
 
+/* Board ioctl commands ****************************************************/
+
+/* Commands accepted by boardctl() through board_ioctl(). Include
+ * <sys/boardctl.h> for BOARDIOC_USER. The argument type is noted for each.
+ */
+
+#define BIOC_PPS_STATUS   (BOARDIOC_USER + 0x0001) /* josh_pps_status_s * */
+#define BIOC_CALIB_GET    (BOARDIOC_USER + 0x0002) /* josh_calib_s * */
+#define BIOC_CALIB_SET    (BOARDIOC_USER + 0x0003) /* const josh_calib_s * */
+#define BIOC_CONFIG_READ  (BOARDIOC_USER + 0x0004) /* josh_config_io_s * */
+#define BIOC_CONFIG_WRITE (BOARDIOC_USER + 0x0005) /* josh_config_io_s * */
+#define BIOC_RADIO_STATS  (BOARDIOC_USER + 0x0006) /* josh_radio_stats_s * */
+#define BIOC_USBPM_STATS  (BOARDIOC_USER + 0x0007) /* josh_usbpm_stats_s * */
+#define BIOC_USBPM_RESUME (BOARDIOC_USER + 0x0008) /* None */
+#define BIOC_LED_CODE     (BOARDIOC_USER + 0x0009) /* josh_led_code_s * */
+#define BIOC_TONE_PLAY    (BOARDIOC_USER + 0x000a) /* josh_tone_seq_s * */
+#define BIOC_TONE_STOP    (BOARDIOC_USER + 0x000b) /* None */
+#define BIOC_GPIO_BATCH   (BOARDIOC_USER + 0x000c) /* josh_gpio_batch_s * */
+#define BIOC_AWD_STATE    (BOARDIOC_USER + 0x000d) /* uint32_t */
+#define BIOC_AWD_SNAPSHOT (BOARDIOC_USER + 0x000e) /* josh_awd_snapshot_s * */
+#define BIOC_AWD_CLEAR    (BOARDIOC_USER + 0x000f) /* None */
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+#ifndef __ASSEMBLY__
+
+/* GNSS PPS timebase status (BIOC_PPS_STATUS) */
+
+struct josh_pps_status_s
+{
+  bool locked;            /* PPS edges are being captured and labelled */
+  uint32_t npulses;       /* PPS edges captured since boot */
+  int32_t drift_ppb;      /* Local oscillator error measured against GNSS */
+  int64_t utc_offset_ns;  /* UTC minus the sensor timestamp clock */
+};
+
+/* Board calibration (BIOC_CALIB_GET/SET), persisted in the EEPROM */
+
+#define JOSH_CALIB_NADC 2 /* Battery voltage, current */
+
+struct josh_calib_adc_s
+{
+  int32_t offset;         /* Counts subtracted before scaling */
+  int32_t scale;          /* uV or uA per count */
+};
+
+struct josh_calib_s
+{
+  struct josh_calib_adc_s adc[JOSH_CALIB_NADC];
+  float xl_bias[3];       /* Accelerometer bias, m/s^2 */
+  float gy_bias[3];       /* Gyroscope bias, rad/s */
+  float mag_hard[3];      /* Magnetometer hard-iron offset, uT */
+  float mag_soft[3][3];   /* Magnetometer soft-iron correction matrix */
+};
+
+/* Access to the EEPROM configuration store (BIOC_CONFIG_READ/WRITE). The
+ * first JOSH_CONFIG_BOARD_SIZE bytes are kept by the board; applications
+ * should not write them.
+ */
+
+#define JOSH_CONFIG_UPLINK_COUNTER 0 /* uint32_t, last uplink counter */
+#define JOSH_CONFIG_BOARD_SIZE     4
+
+struct josh_config_io_s
+{
+  uint16_t offset;        /* Byte offset in the configuration */
+  uint16_t len;           /* Number of bytes */
+  FAR void *buf;          /* Source or destination */
+};
+
+/* Radio transmit priorities, highest first. Records written to
+ * /dev/rn2483q<n> are queued at priority n.
+ */
+
+enum josh_radio_prio_e
+{
+  JOSH_RADIO_CRITICAL = 0,  /* Flight state */
+  JOSH_RADIO_GNSS,          /* Position */
+  JOSH_RADIO_BULK,          /* Other sensor data */
+  JOSH_RADIO_NPRIO
+};
+
+/* Radio transmit statistics (BIOC_RADIO_STATS) */
+
+struct josh_radio_stats_s
+{
+  uint32_t frames;                 /* Frames transmitted */
+  uint32_t records;                /* Records carried in those frames */
+  uint32_t dropped;                /* Records refused, queue full */
+  uint32_t errors;                 /* Frames the modem failed to send */
+  uint32_t throttled;              /* Waits for airtime budget */
+  uint64_t airtime_us;             /* Total time on air */
+  uint32_t budget_us;              /* Airtime currently available */
+  uint16_t utilization_permille;   /* Time on air since start */
+  uint8_t queued[JOSH_RADIO_NPRIO];
+  uint32_t rx_windows;             /* Uplink receive windows opened */
+  uint32_t rx_commands;            /* Uplink commands accepted */
+  uint32_t rx_rejected;            /* Uplink frames rejected */
+};
+
+/* USB suspend power management (BIOC_USBPM_STATS) */
+
+struct josh_usbpm_stats_s
+{
+  bool suspended;                  /* Low power state is in effect */
+  uint32_t suspends;               /* Suspends since boot */
+  uint32_t resumes;                /* Resumes since boot */
+  uint32_t suspend_ns;             /* Time to enter the last suspend */
+  uint32_t resume_ns;              /* Time to restore the last resume */
+  uint32_t max_resume_ns;          /* Slowest resume since boot */
+};
+
+/* LED blink codes (BIOC_LED_CODE). Each LED repeats 'count' blinks then a
+ * pause. Timing fields left at zero use 200ms on, 300ms off and a 1.5s
+ * pause; none may exceed 6553ms.
+ */
+
+#define JOSH_LED_STATUS  0     /* Green, PA4: flight phase */
+#define JOSH_LED_ERROR   1     /* Red, PA5: error class */
+#define JOSH_LED_ARMED   2     /* Green, PD3: arming state */
+#define JOSH_NLEDS       3
+
+#define JOSH_LED_SOLID   0xff  /* count: steadily on */
+
+struct josh_led_code_s
+{
+  uint8_t led;                     /* JOSH_LED_* */
+  uint8_t count;                   /* Blinks per repetition, 0 for off */
+  uint16_t on_ms;                  /* Each blink */
+  uint16_t off_ms;                 /* Between blinks */
+  uint16_t pause_ms;               /* After the last blink */
+};
+
+/* Buzzer tone sequences (BIOC_TONE_PLAY). A tone of 0 Hz is a rest.
+ * Tones run from 20Hz to 20kHz and may last up to 65536 periods.
+ */
+
+#define JOSH_TONE_ARMING     1     /* Rising chirp */
+#define JOSH_TONE_GNSS_LOCK  2     /* Two short beeps */
+#define JOSH_TONE_BEACON     3     /* Recovery beacon, set loop */
+
+struct josh_tone_s
+{
+  uint16_t hz;                     /* Pitch, 0 for a rest */
+  uint16_t ms;                     /* Duration */
+};
+
+struct josh_tone_seq_s
+{
+  uint8_t builtin;                 /* JOSH_TONE_*, or 0 to play tones */
+  bool loop;                       /* Repeat until BIOC_TONE_STOP */
+  uint16_t ntones;
+  FAR const struct josh_tone_s *tones;
+};
+
+/* Write the board's GPIO outputs on one port and snapshot its pins
+ * (BIOC_GPIO_BATCH). Masks are by pin number on the port; only the
+ * board's GPIO pins may be used. The only output is the SD eject LED on
+ * PD3, so in practice this is a single-pin write followed by a read of
+ * the port's pins, interlock inputs included. It is not an atomic
+ * multi-pin write.
+ */
+
+struct josh_gpio_batch_s
+{
+  uint8_t port;                    /* 0 for GPIOA, 1 for GPIOB, ... */
+  uint16_t set;                    /* Outputs to drive high */
+  uint16_t clear;                  /* Outputs to drive low */
+  uint16_t value;                  /* Returned: levels after the write */
+};
+
+/* Uplink command, published on /dev/uorb/josh_uplink0. The meaning of the
+ * arguments is up to the command.
+ */
+
+#define JOSH_UPLINK_MAXARGS  32
+
+#define JOSH_UPLINK_DUMP_STATE  0x01  /* Send a full state report */
+#define JOSH_UPLINK_SET_RATE    0x02  /* args[0]: telemetry rate, Hz */
+
+struct josh_uplink_cmd_s
+{
+  uint64_t timestamp;              /* Time received, us */
+  uint32_t counter;                /* Sender's frame counter */
+  uint8_t cmd;                     /* JOSH_UPLINK_* command */
+  uint8_t len;                     /* Bytes used in args */
+  uint8_t args[JOSH_UPLINK_MAXARGS];
+};
+
+/* Analog watchdog event snapshot, written to backup SRAM by the interrupt
+ * handler (BIOC_AWD_SNAPSHOT/CLEAR). 'state' is the last word flight
+ * software passed to BIOC_AWD_STATE; the board does not interpret it.
+ */
+
+#define JOSH_AWD_VBAT      (1 << 0)  /* Battery left its threshold window */
+#define JOSH_AWD_PYRO      (1 << 1)  /* Pyro continuity left its window */
+
+#define JOSH_AWD_ARM_SW    (1 << 0)  /* Arming switch input high */
+#define JOSH_AWD_BREAKWIRE (1 << 1)  /* Breakwire input high */
+#define JOSH_AWD_UMBILICAL (1 << 2)  /* Umbilical input high */
+
+struct josh_awd_snapshot_s
+{
+  struct timespec time;   /* Wall time of the last event */
+  uint64_t uptime_us;     /* Sensor timestamp of the last event */
+  uint32_t state;         /* Flight state at the last event */
+  uint32_t nevents;       /* Events since the snapshot was cleared */
+  uint8_t sources;        /* JOSH_AWD_* seen in the last event */
+  uint8_t interlocks;     /* JOSH_AWD_* input levels at the last event */
+};
+
+#endif /* __ASSEMBLY__ */
+
 /****************************************************************************
  * Public Data
  ****************************************************************************/
@@ -27,8 +27,12 @@
 
 #include <nuttx/config.h>
 #include <nuttx/compiler.h>
+#include <nuttx/irq.h>
 
 #include <stdint.h>
+#include <time.h>
+
+#include <arch/board/board.h>
 
 /****************************************************************************
  * Pre-processor Definitions
@@ -93,7 +97,8 @@
 /* Check if we can support the RTC driver */
 
 #define HAVE_RTC_DRIVER 1
-#if !defined(CONFIG_RTC) || !defined(CONFIG_RTC_DRIVER)
+#if !defined(CONFIG_RTC) || !defined(CONFIG_RTC_DRIVER) || \
+    !defined(CONFIG_STM32H7_RTC)
 #  undef HAVE_RTC_DRIVER
 #endif
 
@@ -117,6 +122,72 @@
 #define GPIO_LED_SD_EJECT (GPIO_OUTPUT | GPIO_PUSHPULL | GPIO_SPEED_50MHz | \
                           GPIO_OUTPUT_SET | GPIO_PORTD | GPIO_PIN3)
 
+/* Flight interlocks for CONFIG_JOSH_INTERLOCKS, pulled up and switched to
+ * ground, on the pins chosen in Kconfig (PE2-PE4 by default):
+ *   - Arming switch: low when armed, /dev/gpio1
+ *   - Breakwire: low while intact, goes high at liftoff, /dev/gpio2
+ *   - Umbilical detect: low while connected, /dev/gpio3
+ * The breakwire and umbilical interrupt on both edges.
+ */
+
+#ifdef CONFIG_JOSH_INTERLOCKS
+#  define BOARD_NGPIOIN   1 /* Amount of GPIO Input pins */
+#  define BOARD_NGPIOINT  2 /* Amount of GPIO Input w/ Interruption pins */
+#else
+#  define BOARD_NGPIOIN   0
+#  define BOARD_NGPIOINT  0
+#endif
+
+#define JOSH_GPIO_PIN(port, pin) (((port) << GPIO_PORT_SHIFT) | \
+                                  ((pin) << GPIO_PIN_SHIFT))
+
+#ifdef CONFIG_JOSH_INTERLOCKS
+#  define GPIO_ARM_SW    (GPIO_INPUT | GPIO_PULLUP | \
+                         JOSH_GPIO_PIN( \
+                           CONFIG_JOSH_INTERLOCK_ARM_PORT, \
+                           CONFIG_JOSH_INTERLOCK_ARM_PIN))
+#  define GPIO_BREAKWIRE (GPIO_INPUT | GPIO_PULLUP | GPIO_EXTI | \
+                         JOSH_GPIO_PIN( \
+                           CONFIG_JOSH_INTERLOCK_BREAKWIRE_PORT, \
+                           CONFIG_JOSH_INTERLOCK_BREAKWIRE_PIN))
+#  define GPIO_UMBILICAL (GPIO_INPUT | GPIO_PULLUP | GPIO_EXTI | \
+                         JOSH_GPIO_PIN( \
+                           CONFIG_JOSH_INTERLOCK_UMBILICAL_PORT, \
+                           CONFIG_JOSH_INTERLOCK_UMBILICAL_PIN))
+
+/* Each EXTI line serves one pin number across all ports */
+
+#  if CONFIG_JOSH_INTERLOCK_BREAKWIRE_PIN == \
+      CONFIG_JOSH_INTERLOCK_UMBILICAL_PIN
+#    error "Breakwire and umbilical detect need different pin numbers"
+#  endif
+
+#  define JOSH_EXTI_TAKEN(pin) ((pin) == 0 || (pin) == 1 || (pin) == 15)
+
+#  if JOSH_EXTI_TAKEN(CONFIG_JOSH_INTERLOCK_BREAKWIRE_PIN) || \
+      JOSH_EXTI_TAKEN(CONFIG_JOSH_INTERLOCK_UMBILICAL_PIN)
+#    error "Interlock interrupt pin shares an EXTI line with a sensor"
+#  endif
+#endif
+
+/* Scope probe outputs for CONFIG_JOSH_PROBE, on spare pins PE7-PE10.
+ * They share a port so every edge is a single BSRR store.
+ */
+
+#define JOSH_PROBE_BSRR   (STM32_GPIOE_BASE + STM32_GPIO_BSRR_OFFSET)
+
+#define JOSH_PROBE_IRQ    7  /* In an interrupt handler */
+#define JOSH_PROBE_SIGNAL 8  /* Delivering a signal */
+#define JOSH_PROBE_IDLE   9  /* Idle loop, high until the next wakeup */
+#define JOSH_PROBE_IMU    10 /* IMU data-ready until published */
+
+#define GPIO_PROBE(n)     (GPIO_OUTPUT | GPIO_PUSHPULL | GPIO_SPEED_100MHz | \
+                           GPIO_OUTPUT_CLEAR | GPIO_PORTE | \
+                           ((n) << GPIO_PIN_SHIFT))
+
+#define stm32_probe_high(n) putreg32(1 << (n), JOSH_PROBE_BSRR)
+#define stm32_probe_low(n)  putreg32(1 << ((n) + 16), JOSH_PROBE_BSRR)
+
 /* IMU interrupt pins */
 
 #define GPIO_XL_INT                                                            \
@@ -133,6 +204,10 @@
   (GPIO_INPUT | GPIO_FLOAT | GPIO_EXTI | GPIO_SPEED_100MHz | GPIO_PORTD |      \
    GPIO_PIN15)
 
+/* GNSS PPS input, L86 1PPS on PA0 (TIM5 CH1) */
+
+#define GPIO_GNSS_PPS GPIO_TIM5_CH1IN
+
 /* Buzzer
  * Josh has an arming buzzer to indicate when it is armed and running.
  */
@@ -167,6 +242,58 @@
 #define SDIO_SLOTNO        0
 #define SDIO_MINOR         0
 
+/* M24C32 EEPROM on I2C2 and the space reserved in it for the calibration
+ * block at CONFIG_JOSH_CALIB_OFFSET
+ */
+
+#define JOSH_EEPROM_SIZE   4096
+#define JOSH_CALIB_SIZE    256
+
+/* Sensor sampling timer */
+
+#define JOSH_SAMPLING_TIMER 6
+
+/* Barometer conversion one-shot timer */
+
+#define JOSH_BARO_TIMER     13
+
+/* GNSS PPS capture timer, must be 32-bit */
+
+#define JOSH_PPS_TIMER      5
+
+/* LED sequencer timer */
+
+#define JOSH_LEDSEQ_TIMER   7
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+#ifndef __ASSEMBLY__
+
+struct file;
+
+/* Radio transmit completion, called from the radio thread with OK or a
+ * negated errno.
+ */
+
+typedef CODE void (*josh_radio_done_t)(FAR void *arg, int result);
+
+#ifdef CONFIG_JOSH_SAMPLING
+/* Sources driven by the sampling timer */
+
+enum josh_sample_src_e
+{
+  JOSH_SAMPLE_XL = 0, /* LSM6DSO32 accelerometer */
+  JOSH_SAMPLE_GY,     /* LSM6DSO32 gyroscope */
+  JOSH_SAMPLE_MAG,    /* LIS2MDL magnetometer */
+  JOSH_SAMPLE_BARO,   /* MS5607 barometer */
+  JOSH_SAMPLE_NSOURCES
+};
+#endif
+
+#endif /* __ASSEMBLY__ */
+
 /****************************************************************************
  * Public Function Prototypes
  ****************************************************************************/
@@ -221,6 +348,19 @@ int stm32_pwm_setup(void);
 int stm32_dev_gpio_init(void);
 #endif
 
+/****************************************************************************
+ * Name: stm32_gpio_batch
+ *
+ * Description:
+ *   Write the board's outputs on one port, then snapshot its board pins
+ *   (BIOC_GPIO_BATCH).
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_DEV_GPIO
+int stm32_gpio_batch(FAR struct josh_gpio_batch_s *batch);
+#endif
+
 /****************************************************************************
  * Name: stm32_adc_setup
  *
@@ -233,4 +373,543 @@ int stm32_dev_gpio_init(void);
 int stm32_adc_setup(void);
 #endif
 
+/****************************************************************************
+ * Name: stm32_sampling_attach
+ *
+ * Description:
+ *   Attach a sensor trigger to the sampling timer. The handler is called
+ *   from the timer interrupt every time the source's rate divider elapses,
+ *   in place of the sensor's own data-ready interrupt. A free-running
+ *   sensor is only read on the tick, not converted on it.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_SAMPLING
+int stm32_sampling_attach(enum josh_sample_src_e src, xcpt_t handler,
+                          FAR void *arg);
+#endif
+
+/****************************************************************************
+ * Name: stm32_sampling_start
+ *
+ * Description:
+ *   Start the sampling timer once all sensors have been attached.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_SAMPLING
+int stm32_sampling_start(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_sampling_timestamp
+ *
+ * Description:
+ *   Return the time (in microseconds) of the most recent sampling tick.
+ *   All samples triggered on that tick share this timestamp.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_SAMPLING
+uint64_t stm32_sampling_timestamp(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_baro_initialize
+ *
+ * Description:
+ *   Register the MS5607 on I2C1 with the non-blocking conversion pipeline.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_BARO_PIPELINE
+int stm32_baro_initialize(int devno);
+#endif
+
+/****************************************************************************
+ * Name: stm32_mag_configure
+ *
+ * Description:
+ *   Apply the LIS2MDL offset cancellation and low-pass filter options.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_MAG_CONFIGURE
+int stm32_mag_configure(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_mag_attach
+ *
+ * Description:
+ *   Attach the LIS2MDL data-ready handler to be dispatched from the IMU
+ *   interrupt rather than from GPIO_MAG_INT.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_MAG_COALESCE
+int stm32_mag_attach(xcpt_t handler, FAR void *arg);
+#endif
+
+/****************************************************************************
+ * Name: stm32_mag_imu_attach
+ *
+ * Description:
+ *   Attach the LSM6DSO32 accelerometer interrupt with the magnetometer
+ *   reads coalesced into it.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_MAG_COALESCE
+int stm32_mag_imu_attach(uint32_t pinset, xcpt_t handler, FAR void *arg);
+#endif
+
+/****************************************************************************
+ * Name: stm32_dmapoll_initialize
+ *
+ * Description:
+ *   Start flushing partial serial receive DMA buffers periodically.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_SERIAL_DMAPOLL
+void stm32_dmapoll_initialize(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_gnss_setup
+ *
+ * Description:
+ *   Negotiate the L86 baud rate and set its fix rate before the L86 driver
+ *   is registered.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_GNSS_SETUP
+int stm32_gnss_setup(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_pps_initialize
+ *
+ * Description:
+ *   Start capturing the GNSS PPS edge on TIM5.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_PPS
+int stm32_pps_initialize(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_pps_gettime
+ *
+ * Description:
+ *   Return the current PPS-disciplined UTC time, or -EAGAIN if the
+ *   timebase is not locked to GNSS.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_PPS
+int stm32_pps_gettime(FAR struct timespec *utc);
+#endif
+
+/****************************************************************************
+ * Name: stm32_pps_status
+ *
+ * Description:
+ *   Report the UTC offset of the sensor timestamp clock and the local
+ *   oscillator drift.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_PPS
+int stm32_pps_status(FAR struct josh_pps_status_s *status);
+#endif
+
+/****************************************************************************
+ * Name: stm32_rtc_initialize
+ *
+ * Description:
+ *   Register the STM32H7 RTC as /dev/rtc0 and set it from the first valid
+ *   GNSS fix.
+ *
+ ****************************************************************************/
+
+#ifdef HAVE_RTC_DRIVER
+int stm32_rtc_initialize(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_adc_calibrate
+ *
+ * Description:
+ *   Set the offset and scale used to convert published ADC2 channel
+ *   'index' (0: battery, 1: current) to engineering units.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_ADC_PUBLISH
+int stm32_adc_calibrate(int index, int32_t offset, int32_t scale);
+#endif
+
+/****************************************************************************
+ * Name: stm32_adc_awd_state, stm32_adc_awd_snapshot, stm32_adc_awd_clear
+ *
+ * Description:
+ *   Set the flight state recorded with analog watchdog events, and read or
+ *   clear the event snapshot kept in backup SRAM.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_ADC_AWD
+int stm32_adc_awd_state(uint32_t state);
+int stm32_adc_awd_snapshot(FAR struct josh_awd_snapshot_s *snap);
+int stm32_adc_awd_clear(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_calib_initialize
+ *
+ * Description:
+ *   Load the board calibration from the EEPROM.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_CALIB
+int stm32_calib_initialize(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_calib_get
+ *
+ * Description:
+ *   Copy out the board calibration currently in use.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_CALIB
+int stm32_calib_get(FAR struct josh_calib_s *calib);
+#endif
+
+/****************************************************************************
+ * Name: stm32_calib_set
+ *
+ * Description:
+ *   Store a new board calibration in the EEPROM and apply it.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_CALIB
+int stm32_calib_set(FAR const struct josh_calib_s *calib);
+#endif
+
+/****************************************************************************
+ * Name: stm32_eeconfig_initialize
+ *
+ * Description:
+ *   Load the EEPROM configuration store into its RAM shadow.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_EECONFIG
+int stm32_eeconfig_initialize(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_eeconfig_read
+ *
+ * Description:
+ *   Read configuration bytes from the RAM shadow.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_EECONFIG
+int stm32_eeconfig_read(size_t offset, FAR void *buf, size_t len);
+#endif
+
+/****************************************************************************
+ * Name: stm32_eeconfig_write
+ *
+ * Description:
+ *   Write configuration bytes to the RAM shadow. The EEPROM is updated in
+ *   the background.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_EECONFIG
+int stm32_eeconfig_write(size_t offset, FAR const void *buf, size_t len);
+#endif
+
+/****************************************************************************
+ * Name: stm32_eeconfig_commit
+ *
+ * Description:
+ *   Start writing pending changes to the EEPROM now instead of after the
+ *   coalescing delay.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_EECONFIG
+void stm32_eeconfig_commit(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_radio_initialize
+ *
+ * Description:
+ *   Start the RN2483 transmit queue and register /dev/rn2483q.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_RADIO
+int stm32_radio_initialize(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_radio_submit
+ *
+ * Description:
+ *   Queue a record for the RN2483 at the given priority without blocking.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_RADIO
+int stm32_radio_submit(enum josh_radio_prio_e prio, FAR const void *buf,
+                       size_t len, josh_radio_done_t done, FAR void *arg);
+#endif
+
+/****************************************************************************
+ * Name: stm32_radio_stats
+ *
+ * Description:
+ *   Return radio transmit and airtime statistics.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_RADIO
+int stm32_radio_stats(FAR struct josh_radio_stats_s *stats);
+#endif
+
+/****************************************************************************
+ * Name: stm32_rn2483_autobaud
+ *
+ * Description:
+ *   Switch the RN2483 link on USART2 to the fastest baud rate the module
+ *   accepts, falling back to 57600.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_RADIO_AUTOBAUD
+int stm32_rn2483_autobaud(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_rn2483_wdt
+ *
+ * Description:
+ *   Bound RN2483 receives and transmits to 'ms' milliseconds with the
+ *   module's radio watchdog.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_UPLINK
+int stm32_rn2483_wdt(unsigned int ms);
+#endif
+
+/****************************************************************************
+ * Name: stm32_uplink_initialize
+ *
+ * Description:
+ *   Load the uplink key and register /dev/uorb/josh_uplink0.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_UPLINK
+int stm32_uplink_initialize(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_uplink_receive
+ *
+ * Description:
+ *   Receive one uplink frame from the RN2483 and publish it if authentic.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_UPLINK
+int stm32_uplink_receive(FAR struct file *dev);
+#endif
+
+/****************************************************************************
+ * Name: stm32_offload_initialize
+ *
+ * Description:
+ *   Start the USB file offload service.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_OFFLOAD
+int stm32_offload_initialize(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_composite_initialize
+ *
+ * Description:
+ *   Bring up the composite USB device: two CDC-ACM ports and the SD card
+ *   as mass storage.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_COMPOSITE
+int stm32_composite_initialize(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_usbhost_initialize
+ *
+ * Description:
+ *   Register the USB host class drivers and start watching the OTG FS port
+ *   for devices.
+ *
+ ****************************************************************************/
+
+#ifdef HAVE_USBHOST
+int stm32_usbhost_initialize(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_usbpm_initialize
+ *
+ * Description:
+ *   Wake from the USB suspend low power state on a bus reset.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_USBPM
+int stm32_usbpm_initialize(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_usbpm_stats
+ *
+ * Description:
+ *   Report USB suspend state and transition latency (BIOC_USBPM_STATS).
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_USBPM
+int stm32_usbpm_stats(FAR struct josh_usbpm_stats_s *stats);
+#endif
+
+/****************************************************************************
+ * Name: stm32_usbpm_resume
+ *
+ * Description:
+ *   Leave the USB suspend low power state now (BIOC_USBPM_RESUME).
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_USBPM
+int stm32_usbpm_resume(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_ledseq_initialize
+ *
+ * Description:
+ *   Claim the LED sequencer timer.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_LEDSEQ
+int stm32_ledseq_initialize(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_ledseq_set
+ *
+ * Description:
+ *   Play a blink code on one of the board LEDs (BIOC_LED_CODE).
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_LEDSEQ
+int stm32_ledseq_set(FAR const struct josh_led_code_s *code);
+#endif
+
+/****************************************************************************
+ * Name: stm32_ledseq_halt
+ *
+ * Description:
+ *   Stop the LED sequencer, e.g. on panic.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_LEDSEQ
+void stm32_ledseq_halt(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_tone_initialize
+ *
+ * Description:
+ *   Claim the DMA stream for the buzzer tone sequencer.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_TONE
+int stm32_tone_initialize(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_tone_play
+ *
+ * Description:
+ *   Play a tone sequence on the buzzer (BIOC_TONE_PLAY).
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_TONE
+int stm32_tone_play(FAR const struct josh_tone_seq_s *seq);
+#endif
+
+/****************************************************************************
+ * Name: stm32_tone_stop
+ *
+ * Description:
+ *   Silence the buzzer (BIOC_TONE_STOP).
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_TONE
+int stm32_tone_stop(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_probe_initialize
+ *
+ * Description:
+ *   Configure the scope probe outputs, driven low.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_PROBE
+void stm32_probe_initialize(void);
+#endif
+
+/****************************************************************************
+ * Name: stm32_probe_imu
+ *
+ * Description:
+ *   Wrap the IMU data-ready handler so JOSH_PROBE_IMU is high from the
+ *   interrupt until the driver has published the sample.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_PROBE_IMU
+void stm32_probe_imu(FAR xcpt_t *handler, FAR void **arg);
+#endif
+
 #endif /* __BOARDS_ARM_STM32H7_JOSH_SRC_JOSH_H */
@@ -0,0 +1,476 @@
+/****************************************************************************
+ * boards/arm/stm32h7/josh/src/josh_frame.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "josh_frame.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define GF_POLY       0x11d /* x^8 + x^4 + x^3 + x^2 + 1 */
+#define GF_NN         255
+#define RS_MAXROOTS   64
+
+/* Byte j of a frame belongs to code j % depth, parity included, so parity
+ * byte p of code i lands here.
+ */
+
+#define FRAME_PARITY(datalen, depth, i, p) \
+  ((datalen) + ((i) + (depth) - (datalen) % (depth)) % (depth) + \
+   (p) * (depth))
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* GF(256) tables, exp doubled so products need no reduction. They are
+ * the only shared state and never change once built.
+ */
+
+static uint8_t g_gf_exp[2 * GF_NN];
+static uint8_t g_gf_log[GF_NN + 1];
+static bool g_gf_ready;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void gf_init(void)
+{
+  unsigned int x = 1;
+  int i;
+
+  for (i = 0; i < GF_NN; i++)
+    {
+      g_gf_exp[i]         = x;
+      g_gf_exp[i + GF_NN] = x;
+      g_gf_log[x]         = i;
+
+      x <<= 1;
+      if (x & 0x100)
+        {
+          x ^= GF_POLY;
+        }
+    }
+
+  g_gf_ready = true;
+}
+
+static inline uint8_t gf_mul(uint8_t a, uint8_t b)
+{
+  return a && b ? g_gf_exp[g_gf_log[a] + g_gf_log[b]] : 0;
+}
+
+static inline uint8_t gf_div(uint8_t a, uint8_t b)
+{
+  return a ? g_gf_exp[g_gf_log[a] + GF_NN - g_gf_log[b]] : 0;
+}
+
+/* alpha^e for any e */
+
+static inline uint8_t gf_pow(int e)
+{
+  e %= GF_NN;
+  return g_gf_exp[e < 0 ? e + GF_NN : e];
+}
+
+/****************************************************************************
+ * Name: rs_generator
+ *
+ * Description:
+ *   g(x) = (x - a^0)(x - a^1)...(x - a^(nroots - 1)), ascending powers
+ *   in gen[0] to gen[nroots].
+ *
+ ****************************************************************************/
+
+static void rs_generator(int nroots, uint8_t *gen)
+{
+  int i;
+  int j;
+
+  memset(gen, 0, nroots + 1);
+  gen[0] = 1;
+
+  for (j = 0; j < nroots; j++)
+    {
+      for (i = j + 1; i > 0; i--)
+        {
+          gen[i] = gen[i - 1] ^ gf_mul(gen[i], gf_pow(j));
+        }
+
+      gen[0] = gf_mul(gen[0], gf_pow(j));
+    }
+}
+
+/****************************************************************************
+ * Name: rs_encode
+ *
+ * Description:
+ *   Systematic encoding of the k data bytes data[0], data[stride], ...
+ *   with generator 'gen'. Parity is written to parity[0], parity[stride],
+ *   ..., highest power first.
+ *
+ ****************************************************************************/
+
+static void rs_encode(int nroots, const uint8_t *gen, const uint8_t *data,
+                      int k, uint8_t *parity, int stride)
+{
+  uint8_t reg[RS_MAXROOTS];
+  uint8_t fb;
+  int i;
+  int j;
+
+  memset(reg, 0, nroots);
+
+  for (i = 0; i < k; i++)
+    {
+      fb = data[i * stride] ^ reg[0];
+      for (j = 0; j < nroots - 1; j++)
+        {
+          reg[j] = reg[j + 1] ^ gf_mul(fb, gen[nroots - 1 - j]);
+        }
+
+      reg[nroots - 1] = gf_mul(fb, gen[0]);
+    }
+
+  for (j = 0; j < nroots; j++)
+    {
+      parity[j * stride] = reg[j];
+    }
+}
+
+/****************************************************************************
+ * Name: rs_decode
+ *
+ * Description:
+ *   Correct the n byte codeword 'cw' in place: syndromes, Berlekamp-Massey
+ *   for the error locator, a Chien search for the error positions and
+ *   Forney's formula for the values.
+ *
+ * Returned Value:
+ *   Number of bytes corrected, or -EBADMSG.
+ *
+ ****************************************************************************/
+
+static int rs_decode(int nroots, uint8_t *cw, int n)
+{
+  uint8_t synd[RS_MAXROOTS];
+  uint8_t lambda[RS_MAXROOTS + 1];
+  uint8_t prev[RS_MAXROOTS + 1];
+  uint8_t tmp[RS_MAXROOTS + 1];
+  uint8_t omega[RS_MAXROOTS];
+  uint8_t b = 1;
+  uint8_t d;
+  uint8_t num;
+  uint8_t den;
+  uint8_t xinv;
+  uint8_t v;
+  bool errors = false;
+  int nerr = 0;
+  int len = 0;
+  int m = 1;
+  int i;
+  int j;
+  int r;
+
+  /* Syndromes S_j = c(a^j) */
+
+  for (j = 0; j < nroots; j++)
+    {
+      v = 0;
+      for (i = 0; i < n; i++)
+        {
+          v = gf_mul(v, gf_pow(j)) ^ cw[i];
+        }
+
+      synd[j] = v;
+      errors |= v != 0;
+    }
+
+  if (!errors)
+    {
+      return 0;
+    }
+
+  /* Berlekamp-Massey */
+
+  memset(lambda, 0, sizeof(lambda));
+  memset(prev, 0, sizeof(prev));
+  lambda[0] = 1;
+  prev[0]   = 1;
+
+  for (r = 0; r < nroots; r++)
+    {
+      d = synd[r];
+      for (i = 1; i <= len; i++)
+        {
+          d ^= gf_mul(lambda[i], synd[r - i]);
+        }
+
+      if (d == 0)
+        {
+          m++;
+          continue;
+        }
+
+      memcpy(tmp, lambda, sizeof(tmp));
+      for (i = 0; i + m <= nroots; i++)
+        {
+          lambda[i + m] ^= gf_mul(gf_div(d, b), prev[i]);
+        }
+
+      if (2 * len <= r)
+        {
+          len = r + 1 - len;
+          memcpy(prev, tmp, sizeof(prev));
+          b = d;
+          m = 1;
+        }
+      else
+        {
+          m++;
+        }
+    }
+
+  if (len > nroots / 2)
+    {
+      return -EBADMSG;
+    }
+
+  /* Omega(x) = S(x) Lambda(x) mod x^nroots */
+
+  for (i = 0; i < nroots; i++)
+    {
+      omega[i] = 0;
+      for (j = 0; j <= i && j <= len; j++)
+        {
+          omega[i] ^= gf_mul(synd[i - j], lambda[j]);
+        }
+    }
+
+  /* Chien search. Byte i has power e = n - 1 - i, so its locator is
+   * X = a^e and Lambda has a root at X^-1.
+   */
+
+  for (i = 0; i < n; i++)
+    {
+      xinv = gf_pow(-(n - 1 - i));
+
+      v = 0;
+      for (j = len; j >= 0; j--)
+        {
+          v = gf_mul(v, xinv) ^ lambda[j];
+        }
+
+      if (v != 0)
+        {
+          continue;
+        }
+
+      /* Forney with first consecutive root a^0:
+       * e = X Omega(X^-1) / Lambda'(X^-1)
+       */
+
+      num = 0;
+      for (j = nroots - 1; j >= 0; j--)
+        {
+          num = gf_mul(num, xinv) ^ omega[j];
+        }
+
+      den = 0;
+      for (j = len - (len % 2 == 0); j >= 1; j -= 2)
+        {
+          den = gf_mul(den, gf_mul(xinv, xinv)) ^ lambda[j];
+        }
+
+      if (den == 0)
+        {
+          return -EBADMSG;
+        }
+
+      cw[i] ^= gf_mul(gf_pow(n - 1 - i), gf_div(num, den));
+      nerr++;
+    }
+
+  return nerr == len ? nerr : -EBADMSG;
+}
+
+/****************************************************************************
+ * Name: frame_check
+ *
+ * Description:
+ *   Validate the configuration for a frame carrying 'datalen' bytes of
+ *   header and payload.
+ *
+ ****************************************************************************/
+
+static int frame_check(const struct josh_frame_cfg_s *cfg, size_t datalen)
+{
+  if (cfg->nroots < 2 || cfg->nroots > RS_MAXROOTS ||
+      (cfg->nroots & 1) != 0 || cfg->depth < 1 ||
+      cfg->depth > JOSH_FRAME_MAXDEPTH)
+    {
+      return -EINVAL;
+    }
+
+  /* Each shortened code must still fit in 255 bytes */
+
+  if ((datalen + cfg->depth - 1) / cfg->depth + cfg->nroots > GF_NN)
+    {
+      return -EMSGSIZE;
+    }
+
+  if (!g_gf_ready)
+    {
+      gf_init();
+    }
+
+  return 0;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: josh_frame_encode
+ ****************************************************************************/
+
+int josh_frame_encode(const struct josh_frame_cfg_s *cfg, uint16_t seq,
+                      const void *payload, size_t len,
+                      uint8_t *frame, size_t size)
+{
+  uint8_t gen[RS_MAXROOTS + 1];
+  size_t datalen = JOSH_FRAME_HDRLEN + len;
+  size_t total = datalen + cfg->nroots * cfg->depth;
+  int ret;
+  int i;
+
+  ret = frame_check(cfg, datalen);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  if (total > size || total > JOSH_FRAME_MAXLEN)
+    {
+      return -EMSGSIZE;
+    }
+
+  frame[0] = JOSH_FRAME_VERSION;
+  frame[1] = seq & 0xff;
+  frame[2] = seq >> 8;
+  memcpy(&frame[JOSH_FRAME_HDRLEN], payload, len);
+
+  rs_generator(cfg->nroots, gen);
+  for (i = 0; i < cfg->depth; i++)
+    {
+      rs_encode(cfg->nroots, gen, &frame[i],
+                (datalen - i + cfg->depth - 1) / cfg->depth,
+                &frame[FRAME_PARITY(datalen, cfg->depth, i, 0)],
+                cfg->depth);
+    }
+
+  return total;
+}
+
+/****************************************************************************
+ * Name: josh_frame_decode
+ ****************************************************************************/
+
+int josh_frame_decode(const struct josh_frame_cfg_s *cfg, uint8_t *frame,
+                      size_t len, uint16_t *seq, const uint8_t **payload,
+                      size_t *paylen)
+{
+  uint8_t cw[GF_NN];
+  size_t datalen;
+  int ncorrected = 0;
+  int k;
+  int i;
+  int j;
+  int ret;
+
+  if (len <= (size_t)JOSH_FRAME_OVERHEAD(cfg->nroots, cfg->depth))
+    {
+      return -EINVAL;
+    }
+
+  datalen = len - cfg->nroots * cfg->depth;
+  ret = frame_check(cfg, datalen);
+  if (ret < 0)
+    {
+      return ret == -EMSGSIZE ? -EINVAL : ret;
+    }
+
+  for (i = 0; i < cfg->depth; i++)
+    {
+      /* De-interleave one code, correct it and put it back */
+
+      k = (datalen - i + cfg->depth - 1) / cfg->depth;
+      for (j = 0; j < k; j++)
+        {
+          cw[j] = frame[i + j * cfg->depth];
+        }
+
+      for (j = 0; j < cfg->nroots; j++)
+        {
+          cw[k + j] = frame[FRAME_PARITY(datalen, cfg->depth, i, j)];
+        }
+
+      ret = rs_decode(cfg->nroots, cw, k + cfg->nroots);
+      if (ret < 0)
+        {
+          return ret;
+        }
+
+      if (ret > 0)
+        {
+          for (j = 0; j < k; j++)
+            {
+              frame[i + j * cfg->depth] = cw[j];
+            }
+
+          for (j = 0; j < cfg->nroots; j++)
+            {
+              frame[FRAME_PARITY(datalen, cfg->depth, i, j)] = cw[k + j];
+            }
+
+          ncorrected += ret;
+        }
+    }
+
+  if (frame[0] != JOSH_FRAME_VERSION)
+    {
+      return -EBADMSG;
+    }
+
+  *seq     = frame[1] | (frame[2] << 8);
+  *payload = &frame[JOSH_FRAME_HDRLEN];
+  *paylen  = datalen - JOSH_FRAME_HDRLEN;
+  return ncorrected;
+}
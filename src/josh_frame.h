@@ -0,0 +1,131 @@
+/****************************************************************************
+ * boards/arm/stm32h7/josh/src/josh_frame.h
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/* Radio downlink framing with Reed-Solomon FEC.
+ *
+ * This file and josh_frame.c only depend on the C library, so the ground
+ * station can build the same encoder and decoder on the host:
+ *
+ *   cc -O2 -c josh_frame.c
+ *
+ * tools/josh_frame_test.c checks them on the host against random payloads,
+ * configurations and injected burst errors.
+ *
+ * The codec keeps no per-configuration state, so frames with different
+ * configurations may be encoded and decoded concurrently. The only shared
+ * state is the GF(256) tables, built on the first call; make one call
+ * before starting concurrent users.
+ *
+ * A frame is:
+ *
+ *   +---------+---------+---------------+------------------------+
+ *   | version | seq     | payload       | parity                 |
+ *   | 1 byte  | 2, LE   | N bytes       | depth * nroots bytes   |
+ *   +---------+---------+---------------+------------------------+
+ *
+ * The frame is split across 'depth' RS(255, 255 - nroots) codes shortened
+ * to fit: byte j of the frame, parity included, belongs to code j % depth.
+ * A burst of B corrupted bytes therefore costs each code at most
+ * ceil(B / depth) errors, and each code corrects up to nroots / 2. The data
+ * bytes are sent in the clear, so an undamaged frame can be read without
+ * decoding.
+ */
+
+#ifndef __BOARDS_ARM_STM32H7_JOSH_SRC_JOSH_FRAME_H
+#define __BOARDS_ARM_STM32H7_JOSH_SRC_JOSH_FRAME_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define JOSH_FRAME_VERSION   1
+#define JOSH_FRAME_HDRLEN    3
+#define JOSH_FRAME_MAXLEN    255 /* Largest LoRa payload */
+#define JOSH_FRAME_MAXDEPTH  8
+
+/* Total bytes added to a payload */
+
+#define JOSH_FRAME_OVERHEAD(nroots, depth) \
+  (JOSH_FRAME_HDRLEN + (nroots) * (depth))
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+struct josh_frame_cfg_s
+{
+  uint8_t nroots;   /* Parity bytes per code, even, 2-64 */
+  uint8_t depth;    /* Interleaving depth, 1-JOSH_FRAME_MAXDEPTH */
+};
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/****************************************************************************
+ * Name: josh_frame_encode
+ *
+ * Description:
+ *   Build a frame around 'len' bytes of payload.
+ *
+ * Returned Value:
+ *   Frame length, or a negated errno: -EINVAL for a bad configuration,
+ *   -EMSGSIZE if the frame does not fit in 'size' or JOSH_FRAME_MAXLEN.
+ *
+ ****************************************************************************/
+
+int josh_frame_encode(const struct josh_frame_cfg_s *cfg, uint16_t seq,
+                      const void *payload, size_t len,
+                      uint8_t *frame, size_t size);
+
+/****************************************************************************
+ * Name: josh_frame_decode
+ *
+ * Description:
+ *   Correct a received frame in place and locate its payload.
+ *
+ * Returned Value:
+ *   Number of bytes corrected, or a negated errno: -EINVAL for a bad
+ *   configuration or length, -EBADMSG if the frame is not correctable or
+ *   has an unknown version.
+ *
+ ****************************************************************************/
+
+int josh_frame_decode(const struct josh_frame_cfg_s *cfg, uint8_t *frame,
+                      size_t len, uint16_t *seq, const uint8_t **payload,
+                      size_t *paylen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BOARDS_ARM_STM32H7_JOSH_SRC_JOSH_FRAME_H */
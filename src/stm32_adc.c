@@ -26,16 +26,31 @@
 
 #include <nuttx/config.h>
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <errno.h>
 #include <debug.h>
 
 #include <nuttx/board.h>
+#include <nuttx/irq.h>
+#include <nuttx/clock.h>
+#include <nuttx/wqueue.h>
+#include <nuttx/fs/fs.h>
 #include <nuttx/analog/adc.h>
+#include <nuttx/sensors/sensor.h>
 #include <arch/board/board.h>
 
+#include "arm_internal.h"
 #include "chip.h"
 #include "stm32_gpio.h"
 #include "stm32_adc.h"
+#ifdef CONFIG_STM32H7_BKPSRAM
+#  include "stm32_pwr.h"
+#endif
 #include "josh.h"
 
 /****************************************************************************
@@ -52,6 +67,149 @@
 
 #define ADC2_NCHANNELS 2
 
+#define ADC2_DEVPATH       "/dev/adc0"
+
+#define ADC2_ISR           (STM32_ADC2_BASE + STM32_ADC_ISR_OFFSET)
+#define ADC2_IER           (STM32_ADC2_BASE + STM32_ADC_IER_OFFSET)
+#define ADC2_CR            (STM32_ADC2_BASE + STM32_ADC_CR_OFFSET)
+#define ADC2_CFGR          (STM32_ADC2_BASE + STM32_ADC_CFGR_OFFSET)
+#define ADC2_CFGR2         (STM32_ADC2_BASE + STM32_ADC_CFGR2_OFFSET)
+#define ADC2_LTR1          (STM32_ADC2_BASE + STM32_ADC_LTR1_OFFSET)
+#define ADC2_HTR1          (STM32_ADC2_BASE + STM32_ADC_HTR1_OFFSET)
+#define ADC2_AWD2CR        (STM32_ADC2_BASE + STM32_ADC_AWD2CR_OFFSET)
+#define ADC2_LTR2          (STM32_ADC2_BASE + STM32_ADC_LTR2_OFFSET)
+#define ADC2_HTR2          (STM32_ADC2_BASE + STM32_ADC_HTR2_OFFSET)
+
+/* Loop iterations to wait for an ongoing conversion to stop */
+
+#define ADC2_STOP_TIMEOUT  10000
+
+#if defined(CONFIG_JOSH_ADC_OVERSAMPLE) || defined(CONFIG_JOSH_ADC_AWD)
+#  define HAVE_ADC2_SETUP 1
+#endif
+
+/* Conversions are 16-bit and so is the driver's data path, so the shifted
+ * oversampling sum must not grow past 16 bits.
+ */
+
+#ifdef CONFIG_JOSH_ADC_OVERSAMPLE
+#  define ADC2_OVS_RATIO   CONFIG_JOSH_ADC_OVERSAMPLE_RATIO
+#  define ADC2_OVS_SHIFT   CONFIG_JOSH_ADC_OVERSAMPLE_SHIFT
+#else
+#  define ADC2_OVS_RATIO   1
+#  define ADC2_OVS_SHIFT   0
+#endif
+
+#if ADC2_OVS_RATIO > (1 << ADC2_OVS_SHIFT)
+#  error "JOSH_ADC_OVERSAMPLE_RATIO must not exceed 2^SHIFT"
+#endif
+
+#if defined(HAVE_ADC2_SETUP) || defined(CONFIG_JOSH_ADC_PUBLISH)
+#  define HAVE_ADC2_OPS 1
+#endif
+
+#ifdef CONFIG_JOSH_ADC_AWD
+#  define ADC2_VBAT_CHANNEL  4
+#  define ADC2_PYRO_CHANNEL  5
+#  define ADC2_AWD_INTS      (ADC_INT_AWD1 | ADC_INT_AWD2)
+
+/* The event snapshot is written by the interrupt handler straight into the
+ * last bytes of the 4 KiB backup SRAM. The magic tells a kept snapshot from
+ * the random contents left after the backup domain lost power.
+ */
+
+#  ifdef CONFIG_STM32H7_BKPSRAM
+#    define ADC2_BKPSRAM_SIZE 4096
+#    define ADC2_AWD_BKP     ((FAR struct adc_awd_bkp_s *) \
+                              (STM32_BKPSRAM_BASE + ADC2_BKPSRAM_SIZE - \
+                               sizeof(struct adc_awd_bkp_s)))
+#    define ADC2_AWD_MAGIC   0x4a415744 /* "JAWD" */
+#  endif
+
+/* Thresholds are configured in counts of a single 16-bit conversion and
+ * compared against the oversampled result.
+ */
+
+#  define ADC2_AWD_THRESHOLD(t) \
+     ((uint32_t)(((uint64_t)(t) * ADC2_OVS_RATIO) >> ADC2_OVS_SHIFT))
+#endif
+
+#ifdef CONFIG_JOSH_ADC_PUBLISH
+/* Index of each published channel in g_adc2_chanlist */
+
+#  define ADC2_VBAT        0
+#  define ADC2_CURRENT     1
+
+#  define ADC2_MIN_INTERVAL 1000 /* us */
+#endif
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_ADC_PUBLISH
+/* Linear calibration: value = (counts - offset) * scale, scale in micro-
+ * units (uV or uA) per count.
+ */
+
+struct adc_cal_s
+{
+  int32_t offset;
+  int32_t scale;
+};
+
+struct adc_topic_s
+{
+  struct sensor_lowerhalf_s lower; /* Sensor upper half interface */
+  int64_t sum;                     /* Counts accumulated by the ISR */
+  uint32_t count;                  /* Samples in sum */
+  bool enabled;                    /* Topic activated */
+};
+
+struct adc_pub_s
+{
+  struct adc_topic_s topic[ADC2_NCHANNELS];
+  struct adc_cal_s cal[ADC2_NCHANNELS];
+  struct work_s work;              /* Periodic publisher */
+  struct file adc;                 /* Keeps ADC2 converting while open */
+  struct adc_msg_s discard[8];     /* Drained from the driver's FIFO */
+  uint32_t interval;               /* Publish interval in us */
+  uint8_t nactive;                 /* Number of enabled topics */
+};
+#endif
+
+#ifdef CONFIG_JOSH_ADC_AWD
+struct adc_awd_s
+{
+  struct work_s work;              /* Flush and re-arm */
+  struct file adc;                 /* Keeps ADC2 converting */
+  uint64_t timestamp;              /* Time of the first pending event */
+  uint32_t state;                  /* Flight state from BIOC_AWD_STATE */
+  uint8_t sources;                 /* Pending JOSH_AWD_* events */
+  bool attached;                   /* Handler chained on the ADC vector */
+};
+
+#ifdef CONFIG_STM32H7_BKPSRAM
+struct adc_awd_bkp_s
+{
+  uint32_t magic;                  /* ADC2_AWD_MAGIC once written */
+  struct josh_awd_snapshot_s snap;
+};
+#endif
+#endif
+
+/****************************************************************************
+ * Private Function Prototypes
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_ADC_PUBLISH
+static int adc_activate(FAR struct sensor_lowerhalf_s *lower,
+                        FAR struct file *filep, bool enable);
+static int adc_set_interval(FAR struct sensor_lowerhalf_s *lower,
+                            FAR struct file *filep,
+                            FAR uint32_t *period_us);
+#endif
+
 /****************************************************************************
  * Private Data
  ****************************************************************************/
@@ -72,16 +230,607 @@ static const uint32_t g_adc2_pinlist[ADC2_NCHANNELS] =
   GPIO_ADC12_INP4,
   GPIO_ADC12_INP5,
 };
+
+#ifdef HAVE_ADC2_OPS
+/* Copy of the ADC2 lower-half operations with ao_setup and ao_bind
+ * wrapped.
+ */
+
+static struct adc_ops_s g_adc2_ops;
+static FAR const struct adc_ops_s *g_adc2_lowerops;
+#endif
+
+#ifdef CONFIG_JOSH_ADC_PUBLISH
+static const struct sensor_ops_s g_adc_sensor_ops =
+{
+  .activate     = adc_activate,
+  .set_interval = adc_set_interval,
+};
+
+/* Upper-half callbacks with au_receive wrapped */
+
+static struct adc_callback_s g_adc2_callback;
+static FAR const struct adc_callback_s *g_adc2_uppercb;
+
+static struct adc_pub_s g_adc_pub =
+{
+  .cal =
+  {
+    [ADC2_VBAT] =
+    {
+      CONFIG_JOSH_ADC_VBAT_OFFSET, CONFIG_JOSH_ADC_VBAT_SCALE
+    },
+    [ADC2_CURRENT] =
+    {
+      CONFIG_JOSH_ADC_CURRENT_OFFSET, CONFIG_JOSH_ADC_CURRENT_SCALE
+    },
+  },
+};
+#endif
+
+#ifdef CONFIG_JOSH_ADC_AWD
+static struct adc_awd_s g_adc_awd;
+#endif
 #endif /* CONFIG_STM32H7_ADC2 */
 
 /****************************************************************************
  * Private Functions
  ****************************************************************************/
 
+#ifdef CONFIG_JOSH_ADC_AWD
+/****************************************************************************
+ * Name: adc_awd_rearm
+ ****************************************************************************/
+
+static void adc_awd_rearm(FAR void *arg)
+{
+  putreg32(ADC2_AWD_INTS, ADC2_ISR);
+  modifyreg32(ADC2_IER, 0, ADC2_AWD_INTS);
+}
+
+/****************************************************************************
+ * Name: adc_awd_worker
+ *
+ * Description:
+ *   Follow up an analog watchdog event: flush all file systems so buffered
+ *   log data reaches the SD card while there is still power to write it,
+ *   then re-arm the watchdogs after a holdoff so a sustained excursion
+ *   does not keep the work queue busy. Runs on LPWORK so the SD card flush
+ *   never holds up the sensor drivers on HPWORK.
+ *
+ ****************************************************************************/
+
+static void adc_awd_worker(FAR void *arg)
+{
+  FAR struct adc_awd_s *awd = (FAR struct adc_awd_s *)arg;
+  irqstate_t flags;
+  uint64_t timestamp;
+  uint8_t sources;
+
+  flags = enter_critical_section();
+  sources   = awd->sources;
+  timestamp = awd->timestamp;
+  awd->sources = 0;
+  leave_critical_section(flags);
+
+  sync();
+
+  awarn("WARNING: ADC2 analog watchdog %02x at %llu\n", sources,
+        (unsigned long long)timestamp);
+
+  work_queue(LPWORK, &awd->work, adc_awd_rearm, awd,
+             MSEC2TICK(CONFIG_JOSH_ADC_AWD_HOLDOFF_MS));
+}
+
+/****************************************************************************
+ * Name: adc_awd_snapshot
+ *
+ * Description:
+ *   Record an event in backup SRAM from the interrupt handler, so it
+ *   survives even if the supply collapses before any work can run.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_STM32H7_BKPSRAM
+static void adc_awd_snapshot(FAR struct adc_awd_s *awd, uint8_t sources)
+{
+  FAR struct adc_awd_bkp_s *bkp = ADC2_AWD_BKP;
+  FAR struct josh_awd_snapshot_s *snap = &bkp->snap;
+
+  if (bkp->magic != ADC2_AWD_MAGIC)
+    {
+      memset(bkp, 0, sizeof(*bkp));
+      bkp->magic = ADC2_AWD_MAGIC;
+    }
+
+  clock_gettime(CLOCK_REALTIME, &snap->time);
+  snap->uptime_us  = awd->timestamp;
+  snap->state      = awd->state;
+  snap->sources    = sources;
+  snap->interlocks = 0;
+#ifdef CONFIG_JOSH_INTERLOCKS
+  snap->interlocks = (stm32_gpioread(GPIO_ARM_SW) ? JOSH_AWD_ARM_SW : 0) |
+                     (stm32_gpioread(GPIO_BREAKWIRE) ?
+                      JOSH_AWD_BREAKWIRE : 0) |
+                     (stm32_gpioread(GPIO_UMBILICAL) ?
+                      JOSH_AWD_UMBILICAL : 0);
+#endif
+  snap->nevents++;
+
+  up_clean_dcache((uintptr_t)bkp, (uintptr_t)(bkp + 1));
+}
+#endif
+
+/****************************************************************************
+ * Name: adc2_awd_interrupt
+ *
+ * Description:
+ *   Chained onto the shared ADC1/2 interrupt. Mask the watchdog that fired,
+ *   record the event and hand the flush off to the low priority work
+ *   queue; the conversion itself is left to the chip driver.
+ *
+ ****************************************************************************/
+
+static int adc2_awd_interrupt(int irq, FAR void *context, FAR void *arg)
+{
+  FAR struct adc_awd_s *awd = (FAR struct adc_awd_s *)arg;
+  uint32_t pending;
+  uint8_t sources = 0;
+
+  pending = getreg32(ADC2_ISR) & getreg32(ADC2_IER) & ADC2_AWD_INTS;
+  if (pending == 0)
+    {
+      return OK;
+    }
+
+  putreg32(pending, ADC2_ISR);
+  modifyreg32(ADC2_IER, pending, 0);
+
+  if (awd->sources == 0)
+    {
+      awd->timestamp = sensor_get_timestamp();
+    }
+
+  if ((pending & ADC_INT_AWD1) != 0)
+    {
+      sources |= JOSH_AWD_VBAT;
+    }
+
+  if ((pending & ADC_INT_AWD2) != 0)
+    {
+      sources |= JOSH_AWD_PYRO;
+    }
+
+  awd->sources |= sources;
+
+#ifdef CONFIG_STM32H7_BKPSRAM
+  adc_awd_snapshot(awd, sources);
+#endif
+
+  if (work_available(&awd->work))
+    {
+      work_queue(LPWORK, &awd->work, adc_awd_worker, awd, 0);
+    }
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: adc2_awd_configure
+ *
+ * Description:
+ *   Program analog watchdog 1 on the battery channel and watchdog 2 on the
+ *   pyro continuity channel. Must be called with ADC2 stopped.
+ *
+ ****************************************************************************/
+
+static void adc2_awd_configure(void)
+{
+  putreg32(ADC2_AWD_THRESHOLD(CONFIG_JOSH_ADC_AWD_VBAT_LOW), ADC2_LTR1);
+  putreg32(ADC2_AWD_THRESHOLD(CONFIG_JOSH_ADC_AWD_VBAT_HIGH), ADC2_HTR1);
+  modifyreg32(ADC2_CFGR, ADC_CFGR_AWD1CH_MASK,
+              ADC_CFGR_AWD1SGL | ADC_CFGR_AWD1EN |
+              (ADC2_VBAT_CHANNEL << ADC_CFGR_AWD1CH_SHIFT));
+
+  putreg32(ADC2_AWD_THRESHOLD(CONFIG_JOSH_ADC_AWD_PYRO_LOW), ADC2_LTR2);
+  putreg32(ADC2_AWD_THRESHOLD(CONFIG_JOSH_ADC_AWD_PYRO_HIGH), ADC2_HTR2);
+  putreg32(1 << ADC2_PYRO_CHANNEL, ADC2_AWD2CR);
+
+  putreg32(ADC2_AWD_INTS, ADC2_ISR);
+  modifyreg32(ADC2_IER, 0, ADC2_AWD_INTS);
+}
+#endif /* CONFIG_JOSH_ADC_AWD */
+
+#ifdef HAVE_ADC2_SETUP
+/****************************************************************************
+ * Name: adc2_setup
+ *
+ * Description:
+ *   Set up ADC2 through the chip driver, then apply the board's extra
+ *   configuration. CFGR and CFGR2 can only be written with no conversion
+ *   ongoing, so the triggered conversion the chip driver armed is stopped
+ *   around the update.
+ *
+ *   With oversampling, each trigger converts every channel in the scan
+ *   RATIO times back to back, and the accumulated sum is right shifted by
+ *   SHIFT before it is written to the data register and moved out by DMA.
+ *
+ ****************************************************************************/
+
+static int adc2_setup(FAR struct adc_dev_s *dev)
+{
+  int timeout;
+  int ret;
+
+  ret = g_adc2_lowerops->ao_setup(dev);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  if ((getreg32(ADC2_CR) & ADC_CR_ADSTART) != 0)
+    {
+      modifyreg32(ADC2_CR, 0, ADC_CR_ADSTP);
+      for (timeout = 0; (getreg32(ADC2_CR) & ADC_CR_ADSTART) != 0;
+           timeout++)
+        {
+          if (timeout >= ADC2_STOP_TIMEOUT)
+            {
+              aerr("ERROR: ADC2 did not stop\n");
+              return -ETIMEDOUT;
+            }
+        }
+    }
+
+#ifdef CONFIG_JOSH_ADC_OVERSAMPLE
+  modifyreg32(ADC2_CFGR2,
+              ADC_CFGR2_OVSR_MASK | ADC_CFGR2_OVSS_MASK | ADC_CFGR2_ROVSE,
+              ((ADC2_OVS_RATIO - 1) << ADC_CFGR2_OVSR_SHIFT) |
+              (ADC2_OVS_SHIFT << ADC_CFGR2_OVSS_SHIFT) |
+              ADC_CFGR2_ROVSE);
+#endif
+
+#ifdef CONFIG_JOSH_ADC_AWD
+  adc2_awd_configure();
+#endif
+
+  /* Re-arm for the next TIM2 trigger */
+
+  modifyreg32(ADC2_CR, 0, ADC_CR_ADSTART);
+  return OK;
+}
+#endif /* HAVE_ADC2_SETUP */
+
+#ifdef CONFIG_JOSH_ADC_PUBLISH
+/****************************************************************************
+ * Name: adc2_receive
+ *
+ * Description:
+ *   Conversion callback from the ADC2 interrupt. Accumulate the sample for
+ *   the publisher, then hand it on to the character driver.
+ *
+ ****************************************************************************/
+
+static int adc2_receive(FAR struct adc_dev_s *dev, uint8_t ch,
+                        int32_t data)
+{
+  FAR struct adc_topic_s *topic;
+  int i;
+
+  for (i = 0; i < ADC2_NCHANNELS; i++)
+    {
+      if (g_adc2_chanlist[i] == ch)
+        {
+          topic = &g_adc_pub.topic[i];
+          topic->sum += data;
+          topic->count++;
+          break;
+        }
+    }
+
+  return g_adc2_uppercb->au_receive(dev, ch, data);
+}
+
+/****************************************************************************
+ * Name: adc2_bind
+ ****************************************************************************/
+
+static int adc2_bind(FAR struct adc_dev_s *dev,
+                     FAR const struct adc_callback_s *callback)
+{
+  g_adc2_uppercb = callback;
+  g_adc2_callback = *callback;
+  g_adc2_callback.au_receive = adc2_receive;
+
+  return g_adc2_lowerops->ao_bind(dev, &g_adc2_callback);
+}
+
+/****************************************************************************
+ * Name: adc_pub_worker
+ *
+ * Description:
+ *   Average the samples accumulated since the last run, convert them to
+ *   volts and amps and publish them.
+ *
+ ****************************************************************************/
+
+static void adc_pub_worker(FAR void *arg)
+{
+  FAR struct adc_pub_s *pub = (FAR struct adc_pub_s *)arg;
+  FAR struct sensor_lowerhalf_s *lower;
+  int64_t sum[ADC2_NCHANNELS];
+  uint32_t count[ADC2_NCHANNELS];
+  uint64_t timestamp;
+  irqstate_t flags;
+  float value[ADC2_NCHANNELS];
+  int i;
+
+  /* The samples come from adc2_receive(). The character driver queues
+   * them as well, for readers of /dev/adc0; empty its FIFO so it does not
+   * fill with stale conversions while only the publisher holds it open.
+   */
+
+  while (file_read(&pub->adc, pub->discard, sizeof(pub->discard)) > 0)
+    {
+    }
+
+  flags = enter_critical_section();
+  for (i = 0; i < ADC2_NCHANNELS; i++)
+    {
+      sum[i]   = pub->topic[i].sum;
+      count[i] = pub->topic[i].count;
+      pub->topic[i].sum   = 0;
+      pub->topic[i].count = 0;
+    }
+
+  leave_critical_section(flags);
+
+  timestamp = sensor_get_timestamp();
+  for (i = 0; i < ADC2_NCHANNELS; i++)
+    {
+      if (count[i] == 0)
+        {
+          continue;
+        }
+
+      value[i] = ((float)sum[i] / count[i] - pub->cal[i].offset) *
+                 pub->cal[i].scale / 1000000.0f;
+    }
+
+  lower = &pub->topic[ADC2_VBAT].lower;
+  if (pub->topic[ADC2_VBAT].enabled && count[ADC2_VBAT] > 0)
+    {
+      struct sensor_volt volt;
+
+      volt.timestamp = timestamp;
+      volt.voltage   = value[ADC2_VBAT];
+      lower->push_event(lower->priv, &volt, sizeof(volt));
+    }
+
+  lower = &pub->topic[ADC2_CURRENT].lower;
+  if (pub->topic[ADC2_CURRENT].enabled && count[ADC2_CURRENT] > 0)
+    {
+      struct sensor_current current;
+
+      current.timestamp = timestamp;
+      current.current   = value[ADC2_CURRENT];
+      lower->push_event(lower->priv, &current, sizeof(current));
+    }
+
+  if (pub->nactive > 0)
+    {
+      work_queue(LPWORK, &pub->work, adc_pub_worker, pub,
+                 USEC2TICK(pub->interval));
+    }
+}
+
+/****************************************************************************
+ * Name: adc_activate
+ *
+ * Description:
+ *   ADC2 only converts while its character driver is open, so the first
+ *   activated topic opens it and the last one closes it again.
+ *
+ ****************************************************************************/
+
+static int adc_activate(FAR struct sensor_lowerhalf_s *lower,
+                        FAR struct file *filep, bool enable)
+{
+  FAR struct adc_topic_s *topic = (FAR struct adc_topic_s *)lower;
+  FAR struct adc_pub_s *pub = &g_adc_pub;
+  int ret;
+
+  if (enable == topic->enabled)
+    {
+      return OK;
+    }
+
+  if (enable && pub->nactive == 0)
+    {
+      ret = file_open(&pub->adc, ADC2_DEVPATH, O_RDONLY | O_NONBLOCK);
+      if (ret < 0)
+        {
+          aerr("ERROR: Failed to open %s: %d\n", ADC2_DEVPATH, ret);
+          return ret;
+        }
+
+      work_queue(LPWORK, &pub->work, adc_pub_worker, pub,
+                 USEC2TICK(pub->interval));
+    }
+
+  topic->enabled = enable;
+  pub->nactive  += enable ? 1 : -1;
+
+  if (pub->nactive == 0)
+    {
+      work_cancel(LPWORK, &pub->work);
+      file_close(&pub->adc);
+    }
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: adc_set_interval
+ *
+ * Description:
+ *   Both topics are published together, at the last interval requested.
+ *
+ ****************************************************************************/
+
+static int adc_set_interval(FAR struct sensor_lowerhalf_s *lower,
+                            FAR struct file *filep,
+                            FAR uint32_t *period_us)
+{
+  if (*period_us < ADC2_MIN_INTERVAL)
+    {
+      *period_us = ADC2_MIN_INTERVAL;
+    }
+
+  g_adc_pub.interval = *period_us;
+  return OK;
+}
+
+/****************************************************************************
+ * Name: adc_pub_register
+ ****************************************************************************/
+
+static int adc_pub_register(void)
+{
+  FAR struct adc_pub_s *pub = &g_adc_pub;
+  int ret;
+  int i;
+
+  pub->interval = USEC_PER_SEC / CONFIG_JOSH_ADC_PUBLISH_RATE;
+  pub->topic[ADC2_VBAT].lower.type    = SENSOR_TYPE_VOLTAGE;
+  pub->topic[ADC2_CURRENT].lower.type = SENSOR_TYPE_CURRENT;
+
+  for (i = 0; i < ADC2_NCHANNELS; i++)
+    {
+      pub->topic[i].lower.ops     = &g_adc_sensor_ops;
+      pub->topic[i].lower.nbuffer = 1;
+
+      ret = sensor_register(&pub->topic[i].lower, 0);
+      if (ret < 0)
+        {
+          aerr("ERROR: Failed to register ADC2 channel %d topic: %d\n",
+               g_adc2_chanlist[i], ret);
+          return ret;
+        }
+    }
+
+  return OK;
+}
+#endif /* CONFIG_JOSH_ADC_PUBLISH */
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
 
+#ifdef CONFIG_JOSH_ADC_PUBLISH
+/****************************************************************************
+ * Name: stm32_adc_calibrate
+ *
+ * Description:
+ *   Set the offset and scale used to convert published channel 'index'.
+ *
+ ****************************************************************************/
+
+int stm32_adc_calibrate(int index, int32_t offset, int32_t scale)
+{
+  irqstate_t flags;
+
+  if (index < 0 || index >= ADC2_NCHANNELS)
+    {
+      return -EINVAL;
+    }
+
+  flags = enter_critical_section();
+  g_adc_pub.cal[index].offset = offset;
+  g_adc_pub.cal[index].scale  = scale;
+  leave_critical_section(flags);
+
+  return OK;
+}
+#endif
+
+#ifdef CONFIG_JOSH_ADC_AWD
+/****************************************************************************
+ * Name: stm32_adc_awd_state
+ *
+ * Description:
+ *   Set the flight state word recorded with every analog watchdog event.
+ *
+ ****************************************************************************/
+
+int stm32_adc_awd_state(uint32_t state)
+{
+  g_adc_awd.state = state;
+  return OK;
+}
+
+/****************************************************************************
+ * Name: stm32_adc_awd_snapshot
+ *
+ * Description:
+ *   Return the analog watchdog event snapshot kept in backup SRAM. It reads
+ *   as all zero when no event has been recorded since it was last cleared.
+ *
+ ****************************************************************************/
+
+int stm32_adc_awd_snapshot(FAR struct josh_awd_snapshot_s *snap)
+{
+#ifdef CONFIG_STM32H7_BKPSRAM
+  FAR struct adc_awd_bkp_s *bkp = ADC2_AWD_BKP;
+  irqstate_t flags;
+
+  if (snap == NULL)
+    {
+      return -EINVAL;
+    }
+
+  flags = enter_critical_section();
+  if (bkp->magic == ADC2_AWD_MAGIC)
+    {
+      *snap = bkp->snap;
+    }
+  else
+    {
+      memset(snap, 0, sizeof(*snap));
+    }
+
+  leave_critical_section(flags);
+  return OK;
+#else
+  return -ENOSYS;
+#endif
+}
+
+/****************************************************************************
+ * Name: stm32_adc_awd_clear
+ *
+ * Description:
+ *   Clear the analog watchdog event snapshot kept in backup SRAM.
+ *
+ ****************************************************************************/
+
+int stm32_adc_awd_clear(void)
+{
+#ifdef CONFIG_STM32H7_BKPSRAM
+  FAR struct adc_awd_bkp_s *bkp = ADC2_AWD_BKP;
+  irqstate_t flags;
+
+  flags = enter_critical_section();
+  bkp->magic = 0;
+  up_clean_dcache((uintptr_t)bkp, (uintptr_t)(bkp + 1));
+  leave_critical_section(flags);
+  return OK;
+#else
+  return -ENOSYS;
+#endif
+}
+#endif
+
 /****************************************************************************
  * Name: stm32_adc_setup
  *
@@ -122,6 +871,18 @@ int stm32_adc_setup(void)
           return -ENODEV;
         }
 
+#ifdef HAVE_ADC2_OPS
+      g_adc2_lowerops     = adc->ad_ops;
+      g_adc2_ops          = *adc->ad_ops;
+#ifdef HAVE_ADC2_SETUP
+      g_adc2_ops.ao_setup = adc2_setup;
+#endif
+#ifdef CONFIG_JOSH_ADC_PUBLISH
+      g_adc2_ops.ao_bind  = adc2_bind;
+#endif
+      adc->ad_ops         = &g_adc2_ops;
+#endif
+
       /* Register the ADC driver at "/dev/adc[0-1]" */
 
       ret = adc_register(devname, adc);
@@ -133,6 +894,59 @@ int stm32_adc_setup(void)
 
       devname[8]++;
 
+#ifdef CONFIG_JOSH_ADC_PUBLISH
+      /* Publish the battery voltage and current channels as uORB
+       * topics.
+       */
+
+      ret = adc_pub_register();
+      if (ret < 0)
+        {
+          return ret;
+        }
+#endif
+
+#ifdef CONFIG_JOSH_ADC_AWD
+#ifdef CONFIG_STM32H7_BKPSRAM
+      /* Keep backup SRAM powered from VBAT and writable, so the interrupt
+       * handler can store a snapshot without any setup of its own.
+       */
+
+      stm32_pwr_enablebreg(true);
+      stm32_pwr_enablebkp(true);
+#endif
+
+      /* Chain the handler once. The chip driver attaches its own on every
+       * setup and detaches the vector on shutdown, but the file opened
+       * below keeps ADC2 set up from here on.
+       */
+
+      if (!g_adc_awd.attached)
+        {
+          ret = irq_attach(STM32_IRQ_ADC12, adc2_awd_interrupt,
+                           &g_adc_awd);
+          if (ret < 0)
+            {
+              aerr("ERROR: Failed to attach the ADC2 watchdogs: %d\n",
+                   ret);
+              return ret;
+            }
+
+          g_adc_awd.attached = true;
+        }
+
+      /* The watchdogs only run while ADC2 is converting, so keep the
+       * driver open for the lifetime of the board.
+       */
+
+      ret = file_open(&g_adc_awd.adc, ADC2_DEVPATH, O_RDONLY | O_NONBLOCK);
+      if (ret < 0)
+        {
+          aerr("ERROR: Failed to open %s: %d\n", ADC2_DEVPATH, ret);
+          return ret;
+        }
+#endif
+
       /* Now we are initialized */
 
       initialized = true;
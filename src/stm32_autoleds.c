@@ -34,6 +34,7 @@
 #include <nuttx/board.h>
 #include <arch/board/board.h>
 
+#include "arm_internal.h"
 #include "stm32_gpio.h"
 #include "josh.h"
 
@@ -54,6 +55,10 @@ void board_autoled_initialize(void)
   stm32_configgpio(GPIO_LED_STARTED);
   stm32_configgpio(GPIO_LED_PANIC);
   stm32_configgpio(GPIO_LED_EJECT);
+
+#ifdef CONFIG_JOSH_PROBE
+  stm32_probe_initialize();
+#endif
 }
 
 /****************************************************************************
@@ -62,11 +67,10 @@ void board_autoled_initialize(void)
 
 void board_autoled_on(int led)
 {
-  ledinfo("board_autoled_on(%d)\n", led);
-
   switch (led)
     {
     case LED_STARTED:
+      ledinfo("board_autoled_on(%d)\n", led);
 
       /* As the board provides only one soft controllable LED, we simply
        * turn it on when the board boots.
@@ -78,10 +82,32 @@ void board_autoled_on(int led)
     case LED_PANIC:
     case LED_ASSERTION:
 
+#ifdef CONFIG_JOSH_LEDSEQ
+      /* Keep the sequencer from overwriting the panic blink */
+
+      stm32_ledseq_halt();
+#endif
+
       /* For panic state, the LED is blinking */
 
       stm32_gpiowrite(GPIO_LED_PANIC, true);
       break;
+
+#ifdef CONFIG_JOSH_PROBE
+    /* Scope probes: one BSRR store each, as these run on every interrupt */
+
+    case LED_INIRQ:
+      stm32_probe_high(JOSH_PROBE_IRQ);
+      break;
+
+    case LED_SIGNAL:
+      stm32_probe_high(JOSH_PROBE_SIGNAL);
+      break;
+
+    case LED_IDLE:
+      stm32_probe_high(JOSH_PROBE_IDLE);
+      break;
+#endif
     }
 }
 
@@ -101,6 +127,20 @@ void board_autoled_off(int led)
     case LED_STARTED:
       stm32_gpiowrite(GPIO_LED_STARTED, false);
       break;
+
+#ifdef CONFIG_JOSH_PROBE
+    case LED_INIRQ:
+      stm32_probe_low(JOSH_PROBE_IRQ);
+      break;
+
+    case LED_SIGNAL:
+      stm32_probe_low(JOSH_PROBE_SIGNAL);
+      break;
+
+    case LED_IDLE:
+      stm32_probe_low(JOSH_PROBE_IDLE);
+      break;
+#endif
     }
 }
 
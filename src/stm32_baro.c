@@ -0,0 +1,673 @@
+/****************************************************************************
+ * boards/arm/stm32h7/josh/src/stm32_baro.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/* Non-blocking MS5607 conversion pipeline.
+ *
+ * The MS5607 needs a separate D1 (pressure) and D2 (temperature) conversion
+ * for every sample, each taking up to 9ms at the highest oversampling
+ * ratio. Instead of sleeping through the conversion with I2C1 idle, each
+ * conversion is started and a one-shot hardware timer is armed for the
+ * conversion time. I2C1 stays free for the IMU and magnetometer until the
+ * timer expires and the result is read back from the high priority work
+ * queue.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/arch.h>
+#include <nuttx/clock.h>
+#include <nuttx/wqueue.h>
+#include <nuttx/i2c/i2c_master.h>
+#include <nuttx/sensors/sensor.h>
+#include <nuttx/timers/oneshot.h>
+
+#include "stm32_i2c.h"
+#include "stm32_oneshot.h"
+#include "josh.h"
+
+#ifdef CONFIG_JOSH_BARO_PIPELINE
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define BARO_I2C_BUS        1
+#define BARO_I2C_ADDR       0x76     /* MS56XX_ADDR1, CSB pulled high */
+#define BARO_I2C_FREQUENCY  400000
+
+/* MS5607 commands */
+
+#define MS5607_CMD_RESET    0x1e
+#define MS5607_CMD_CONV_D1  0x40
+#define MS5607_CMD_CONV_D2  0x50
+#define MS5607_CMD_ADC_READ 0x00
+#define MS5607_CMD_PROM(n)  (0xa0 + ((n) << 1))
+
+#define MS5607_PROM_WORDS   8
+#define MS5607_RESET_US     2800
+
+/* Oversampling ratio command offset and worst case conversion time */
+
+#if CONFIG_JOSH_BARO_OSR == 256
+#  define MS5607_OSR        0x00
+#  define MS5607_CONV_US    600
+#elif CONFIG_JOSH_BARO_OSR == 512
+#  define MS5607_OSR        0x02
+#  define MS5607_CONV_US    1170
+#elif CONFIG_JOSH_BARO_OSR == 1024
+#  define MS5607_OSR        0x04
+#  define MS5607_CONV_US    2280
+#elif CONFIG_JOSH_BARO_OSR == 2048
+#  define MS5607_OSR        0x06
+#  define MS5607_CONV_US    4540
+#elif CONFIG_JOSH_BARO_OSR == 4096
+#  define MS5607_OSR        0x08
+#  define MS5607_CONV_US    9040
+#else
+#  error "CONFIG_JOSH_BARO_OSR must be one of 256, 512, 1024, 2048, 4096"
+#endif
+
+/* Shortest interval: one D1 conversion, plus a D2 conversion if the
+ * temperature is measured on every sample.
+ */
+
+#if CONFIG_JOSH_BARO_TEMP_DECIMATION > 1
+#  define BARO_MIN_INTERVAL (MS5607_CONV_US + \
+                             MS5607_CONV_US / CONFIG_JOSH_BARO_TEMP_DECIMATION)
+#else
+#  define BARO_MIN_INTERVAL (2 * MS5607_CONV_US)
+#endif
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+enum baro_state_e
+{
+  BARO_IDLE = 0,    /* No conversion in progress */
+  BARO_CONV_D2,     /* Temperature conversion in progress */
+  BARO_CONV_D1,     /* Pressure conversion in progress */
+};
+
+struct baro_calib_s
+{
+  uint16_t c1;      /* Pressure sensitivity */
+  uint16_t c2;      /* Pressure offset */
+  uint16_t c3;      /* Temperature coefficient of pressure sensitivity */
+  uint16_t c4;      /* Temperature coefficient of pressure offset */
+  uint16_t c5;      /* Reference temperature */
+  uint16_t c6;      /* Temperature coefficient of the temperature */
+};
+
+struct baro_comp_s
+{
+  int32_t temp;     /* Compensated temperature, 0.01C */
+  int64_t off;      /* Pressure offset at that temperature */
+  int64_t sens;     /* Pressure sensitivity at that temperature */
+};
+
+struct baro_dev_s
+{
+  struct sensor_lowerhalf_s lower;      /* Sensor upper half interface */
+  FAR struct i2c_master_s *i2c;         /* I2C1 */
+  FAR struct oneshot_lowerhalf_s *tim;  /* Conversion timer */
+  struct work_s work;                   /* Conversion state machine */
+  struct baro_calib_s calib;            /* Factory calibration from PROM */
+  enum baro_state_e state;              /* Current conversion */
+  uint32_t interval;                    /* Sample interval in us */
+  struct baro_comp_s comp;              /* Cached temperature terms */
+  uint16_t temp_count;                  /* Samples until next D2 */
+  uint64_t timestamp;                   /* Start of current sample */
+  bool enabled;                         /* Sensor activated */
+};
+
+/****************************************************************************
+ * Private Function Prototypes
+ ****************************************************************************/
+
+static void baro_worker(FAR void *arg);
+static int baro_activate(FAR struct sensor_lowerhalf_s *lower,
+                         FAR struct file *filep, bool enable);
+static int baro_set_interval(FAR struct sensor_lowerhalf_s *lower,
+                             FAR struct file *filep,
+                             FAR uint32_t *period_us);
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const struct sensor_ops_s g_baro_ops =
+{
+  .activate     = baro_activate,
+  .set_interval = baro_set_interval,
+};
+
+static struct baro_dev_s g_baro;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: baro_command
+ *
+ * Description:
+ *   Send a single byte command to the MS5607.
+ *
+ ****************************************************************************/
+
+static int baro_command(FAR struct baro_dev_s *dev, uint8_t cmd)
+{
+  struct i2c_msg_s msg;
+
+  msg.frequency = BARO_I2C_FREQUENCY;
+  msg.addr      = BARO_I2C_ADDR;
+  msg.flags     = 0;
+  msg.buffer    = &cmd;
+  msg.length    = 1;
+
+  return I2C_TRANSFER(dev->i2c, &msg, 1);
+}
+
+/****************************************************************************
+ * Name: baro_read
+ *
+ * Description:
+ *   Send a command and read back a big-endian result of 'len' bytes.
+ *
+ ****************************************************************************/
+
+static int baro_read(FAR struct baro_dev_s *dev, uint8_t cmd,
+                     FAR uint32_t *value, size_t len)
+{
+  struct i2c_msg_s msg[2];
+  uint8_t buf[3];
+  size_t i;
+  int ret;
+
+  DEBUGASSERT(len <= sizeof(buf));
+
+  msg[0].frequency = BARO_I2C_FREQUENCY;
+  msg[0].addr      = BARO_I2C_ADDR;
+  msg[0].flags     = 0;
+  msg[0].buffer    = &cmd;
+  msg[0].length    = 1;
+
+  msg[1].frequency = BARO_I2C_FREQUENCY;
+  msg[1].addr      = BARO_I2C_ADDR;
+  msg[1].flags     = I2C_M_READ;
+  msg[1].buffer    = buf;
+  msg[1].length    = len;
+
+  ret = I2C_TRANSFER(dev->i2c, msg, 2);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  *value = 0;
+  for (i = 0; i < len; i++)
+    {
+      *value = (*value << 8) | buf[i];
+    }
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: baro_crc4
+ *
+ * Description:
+ *   Compute the 4-bit CRC stored in the low nibble of PROM word 7.
+ *
+ ****************************************************************************/
+
+static uint8_t baro_crc4(FAR const uint16_t *prom)
+{
+  uint16_t words[MS5607_PROM_WORDS];
+  uint16_t rem = 0;
+  int cnt;
+  int bit;
+
+  /* The CRC nibble and the reserved bits around it are excluded from the
+   * computation (AN520).
+   */
+
+  memcpy(words, prom, sizeof(words));
+  words[MS5607_PROM_WORDS - 1] &= 0xff00;
+
+  for (cnt = 0; cnt < 2 * MS5607_PROM_WORDS; cnt++)
+    {
+      if (cnt & 1)
+        {
+          rem ^= words[cnt >> 1] & 0x00ff;
+        }
+      else
+        {
+          rem ^= words[cnt >> 1] >> 8;
+        }
+
+      for (bit = 8; bit > 0; bit--)
+        {
+          rem = (rem & 0x8000) ? (rem << 1) ^ 0x3000 : (rem << 1);
+        }
+    }
+
+  return (rem >> 12) & 0x0f;
+}
+
+/****************************************************************************
+ * Name: baro_read_prom
+ *
+ * Description:
+ *   Read and verify the factory calibration coefficients.
+ *
+ ****************************************************************************/
+
+static int baro_read_prom(FAR struct baro_dev_s *dev)
+{
+  uint16_t prom[MS5607_PROM_WORDS];
+  uint32_t word;
+  int ret;
+  int i;
+
+  for (i = 0; i < MS5607_PROM_WORDS; i++)
+    {
+      ret = baro_read(dev, MS5607_CMD_PROM(i), &word, 2);
+      if (ret < 0)
+        {
+          return ret;
+        }
+
+      prom[i] = (uint16_t)word;
+    }
+
+  if (baro_crc4(prom) != (prom[7] & 0x0f))
+    {
+      snerr("ERROR: MS5607 PROM CRC mismatch\n");
+      return -EIO;
+    }
+
+  dev->calib.c1 = prom[1];
+  dev->calib.c2 = prom[2];
+  dev->calib.c3 = prom[3];
+  dev->calib.c4 = prom[4];
+  dev->calib.c5 = prom[5];
+  dev->calib.c6 = prom[6];
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: baro_update_temperature
+ *
+ * Description:
+ *   Compute the temperature and the temperature dependent pressure offset
+ *   and sensitivity from a new D2 reading, as described in the MS5607
+ *   datasheet. The results are cached until the next D2 conversion.
+ *
+ ****************************************************************************/
+
+static void baro_update_temperature(FAR struct baro_dev_s *dev, uint32_t d2)
+{
+  FAR const struct baro_calib_s *c = &dev->calib;
+  int64_t off;
+  int64_t sens;
+  int32_t dt;
+  int32_t t;
+
+  dt   = (int32_t)d2 - ((int32_t)c->c5 << 8);
+  t    = 2000 + (int32_t)(((int64_t)dt * c->c6) >> 23);
+  off  = ((int64_t)c->c2 << 17) + (((int64_t)c->c4 * dt) >> 6);
+  sens = ((int64_t)c->c1 << 16) + (((int64_t)c->c3 * dt) >> 7);
+
+#ifdef CONFIG_MS56XX_SECOND_ORDER_COMPENSATE
+  if (t < 2000)
+    {
+      int64_t t2    = ((int64_t)dt * dt) >> 31;
+      int64_t off2  = (61 * (int64_t)(t - 2000) * (t - 2000)) >> 4;
+      int64_t sens2 = 2 * (int64_t)(t - 2000) * (t - 2000);
+
+      if (t < -1500)
+        {
+          off2  += 15 * (int64_t)(t + 1500) * (t + 1500);
+          sens2 += 8 * (int64_t)(t + 1500) * (t + 1500);
+        }
+
+      t    -= (int32_t)t2;
+      off  -= off2;
+      sens -= sens2;
+    }
+#endif
+
+  dev->comp.temp = t;
+  dev->comp.off  = off;
+  dev->comp.sens = sens;
+}
+
+/****************************************************************************
+ * Name: baro_pressure
+ *
+ * Description:
+ *   Convert a raw D1 reading to pressure (Pa) using the cached temperature
+ *   compensation terms.
+ *
+ ****************************************************************************/
+
+static int32_t baro_pressure(FAR struct baro_dev_s *dev, uint32_t d1)
+{
+  return (int32_t)((((int64_t)d1 * dev->comp.sens >> 21) - dev->comp.off)
+                   >> 15);
+}
+
+/****************************************************************************
+ * Name: baro_timer_expired
+ *
+ * Description:
+ *   One-shot timer callback, the current conversion is complete.
+ *
+ ****************************************************************************/
+
+static void baro_timer_expired(FAR struct oneshot_lowerhalf_s *lower,
+                               FAR void *arg)
+{
+  FAR struct baro_dev_s *dev = arg;
+
+  work_queue(HPWORK, &dev->work, baro_worker, dev, 0);
+}
+
+/****************************************************************************
+ * Name: baro_start_conversion
+ *
+ * Description:
+ *   Start a D1 or D2 conversion and arm the one-shot timer for its
+ *   completion. I2C1 is released as soon as the command has been sent.
+ *
+ ****************************************************************************/
+
+static int baro_start_conversion(FAR struct baro_dev_s *dev, uint8_t cmd,
+                                 enum baro_state_e state)
+{
+  struct timespec ts;
+  int ret;
+
+  ret = baro_command(dev, cmd | MS5607_OSR);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  dev->state = state;
+
+  ts.tv_sec  = 0;
+  ts.tv_nsec = MS5607_CONV_US * NSEC_PER_USEC;
+
+  return ONESHOT_START(dev->tim, baro_timer_expired, dev, &ts);
+}
+
+/****************************************************************************
+ * Name: baro_worker
+ *
+ * Description:
+ *   Conversion state machine, runs on the high priority work queue every
+ *   time a sample is triggered or a conversion completes.
+ *
+ ****************************************************************************/
+
+static void baro_worker(FAR void *arg)
+{
+  FAR struct baro_dev_s *dev = arg;
+  struct sensor_baro baro;
+  uint32_t raw;
+  int ret = OK;
+
+  switch (dev->state)
+    {
+      case BARO_IDLE:
+#ifndef CONFIG_JOSH_SAMPLING
+        dev->timestamp = sensor_get_timestamp();
+#endif
+
+        /* Temperature drifts slowly, so D2 is only converted every
+         * CONFIG_JOSH_BARO_TEMP_DECIMATION samples and its compensation
+         * terms are reused in between.
+         */
+
+        if (dev->temp_count == 0)
+          {
+            dev->temp_count = CONFIG_JOSH_BARO_TEMP_DECIMATION;
+            ret = baro_start_conversion(dev, MS5607_CMD_CONV_D2,
+                                        BARO_CONV_D2);
+          }
+        else
+          {
+            ret = baro_start_conversion(dev, MS5607_CMD_CONV_D1,
+                                        BARO_CONV_D1);
+          }
+
+        dev->temp_count--;
+        break;
+
+      case BARO_CONV_D2:
+        ret = baro_read(dev, MS5607_CMD_ADC_READ, &raw, 3);
+        if (ret >= 0)
+          {
+            baro_update_temperature(dev, raw);
+            ret = baro_start_conversion(dev, MS5607_CMD_CONV_D1,
+                                        BARO_CONV_D1);
+          }
+        break;
+
+      case BARO_CONV_D1:
+        ret = baro_read(dev, MS5607_CMD_ADC_READ, &raw, 3);
+        if (ret < 0)
+          {
+            break;
+          }
+
+        baro.timestamp   = dev->timestamp;
+        baro.pressure    = baro_pressure(dev, raw) / 100.0f; /* Pa to mbar */
+        baro.temperature = dev->comp.temp / 100.0f;
+
+        dev->lower.push_event(dev->lower.priv, &baro, sizeof(baro));
+
+        /* Only now may the sampling tick stamp and start the next sample.
+         * The work is no longer pending while this runs, so the state is
+         * all that keeps a tick from overwriting the timestamp above.
+         */
+
+        dev->state = BARO_IDLE;
+
+#ifndef CONFIG_JOSH_SAMPLING
+        /* Pace the next sample off the start of this one */
+
+        if (dev->enabled)
+          {
+            uint64_t elapsed = sensor_get_timestamp() - dev->timestamp;
+            uint32_t delay = 0;
+
+            if (elapsed < dev->interval)
+              {
+                delay = USEC2TICK(dev->interval - elapsed);
+              }
+
+            work_queue(HPWORK, &dev->work, baro_worker, dev, delay);
+          }
+#endif
+        break;
+    }
+
+  if (ret < 0)
+    {
+      snerr("ERROR: MS5607 conversion failed: %d\n", ret);
+      dev->state = BARO_IDLE;
+      dev->temp_count = 0;
+    }
+}
+
+#ifdef CONFIG_JOSH_SAMPLING
+/****************************************************************************
+ * Name: baro_trigger
+ *
+ * Description:
+ *   Sampling timer trigger. Starts a new sample if the previous one has
+ *   completed, otherwise the tick is dropped.
+ *
+ ****************************************************************************/
+
+static int baro_trigger(int irq, FAR void *context, FAR void *arg)
+{
+  FAR struct baro_dev_s *dev = arg;
+
+  if (dev->enabled && dev->state == BARO_IDLE && work_available(&dev->work))
+    {
+      /* Stamp the sample with the tick, not with when the worker runs */
+
+      dev->timestamp = stm32_sampling_timestamp();
+      work_queue(HPWORK, &dev->work, baro_worker, dev, 0);
+    }
+
+  return OK;
+}
+#endif
+
+/****************************************************************************
+ * Name: baro_activate
+ ****************************************************************************/
+
+static int baro_activate(FAR struct sensor_lowerhalf_s *lower,
+                         FAR struct file *filep, bool enable)
+{
+  FAR struct baro_dev_s *dev = (FAR struct baro_dev_s *)lower;
+
+  if (enable == dev->enabled)
+    {
+      return OK;
+    }
+
+  dev->enabled = enable;
+
+#ifndef CONFIG_JOSH_SAMPLING
+  if (enable)
+    {
+      return work_queue(HPWORK, &dev->work, baro_worker, dev, 0);
+    }
+#endif
+
+  if (!enable)
+    {
+      ONESHOT_CANCEL(dev->tim, NULL);
+      work_cancel(HPWORK, &dev->work);
+      dev->state = BARO_IDLE;
+      dev->temp_count = 0;
+    }
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: baro_set_interval
+ ****************************************************************************/
+
+static int baro_set_interval(FAR struct sensor_lowerhalf_s *lower,
+                             FAR struct file *filep,
+                             FAR uint32_t *period_us)
+{
+  FAR struct baro_dev_s *dev = (FAR struct baro_dev_s *)lower;
+
+  if (*period_us < BARO_MIN_INTERVAL)
+    {
+      *period_us = BARO_MIN_INTERVAL;
+    }
+
+  dev->interval = *period_us;
+  return OK;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: stm32_baro_initialize
+ *
+ * Description:
+ *   Reset the MS5607 on I2C1, read its calibration and register it as a
+ *   uORB barometer driven by the non-blocking conversion pipeline.
+ *
+ ****************************************************************************/
+
+int stm32_baro_initialize(int devno)
+{
+  FAR struct baro_dev_s *dev = &g_baro;
+  int ret;
+
+  dev->i2c = stm32_i2cbus_initialize(BARO_I2C_BUS);
+  if (dev->i2c == NULL)
+    {
+      return -ENODEV;
+    }
+
+  dev->tim = oneshot_initialize(JOSH_BARO_TIMER, 1);
+  if (dev->tim == NULL)
+    {
+      snerr("ERROR: Failed to get TIM%d one-shot\n", JOSH_BARO_TIMER);
+      return -ENODEV;
+    }
+
+  ret = baro_command(dev, MS5607_CMD_RESET);
+  if (ret < 0)
+    {
+      snerr("ERROR: MS5607 reset failed: %d\n", ret);
+      return ret;
+    }
+
+  up_udelay(MS5607_RESET_US);
+
+  ret = baro_read_prom(dev);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  dev->interval      = BARO_MIN_INTERVAL;
+  dev->state         = BARO_IDLE;
+  dev->lower.type    = SENSOR_TYPE_BAROMETER;
+  dev->lower.ops     = &g_baro_ops;
+  dev->lower.nbuffer = 1;
+
+#ifdef CONFIG_JOSH_SAMPLING
+  stm32_sampling_attach(JOSH_SAMPLE_BARO, baro_trigger, dev);
+#endif
+
+  return sensor_register(&dev->lower, devno);
+}
+
+#endif /* CONFIG_JOSH_BARO_PIPELINE */
@@ -76,6 +76,10 @@
 #include "stm32_adc.h"
 #endif
 
+#if defined(CONFIG_JOSH_OFFLOAD) && !defined(CONFIG_JOSH_COMPOSITE)
+#include <nuttx/usb/cdcacm.h>
+#endif
+
 /****************************************************************************
  * Pre-processor Directives
  ****************************************************************************/
@@ -127,11 +131,15 @@ static void partition_handler(struct partition_s *part, void *arg) {
  ****************************************************************************/
 
 static int josh_lsm6dso32_gy_attach(xcpt_t handler, FAR void *arg) {
+#ifdef CONFIG_JOSH_SAMPLING
+  return stm32_sampling_attach(JOSH_SAMPLE_GY, handler, arg);
+#else
   int err = stm32_configgpio(GPIO_GY_INT);
   if (err < 0) {
     return err;
   }
   return stm32_gpiosetevent(GPIO_GY_INT, true, false, false, handler, arg);
+#endif
 }
 
 /****************************************************************************
@@ -143,11 +151,21 @@ static int josh_lsm6dso32_gy_attach(xcpt_t handler, FAR void *arg) {
  ****************************************************************************/
 
 static int josh_lsm6dso32_xl_attach(xcpt_t handler, FAR void *arg) {
+#ifdef CONFIG_JOSH_PROBE_IMU
+  stm32_probe_imu(&handler, &arg);
+#endif
+
+#if defined(CONFIG_JOSH_SAMPLING)
+  return stm32_sampling_attach(JOSH_SAMPLE_XL, handler, arg);
+#elif defined(CONFIG_JOSH_MAG_COALESCE)
+  return stm32_mag_imu_attach(GPIO_XL_INT, handler, arg);
+#else
   int err = stm32_configgpio(GPIO_XL_INT);
   if (err < 0) {
     return err;
   }
   return stm32_gpiosetevent(GPIO_XL_INT, true, false, false, handler, arg);
+#endif
 }
 #endif
 
@@ -161,11 +179,17 @@ static int josh_lsm6dso32_xl_attach(xcpt_t handler, FAR void *arg) {
  ****************************************************************************/
 
 static int josh_lis2mdl_attach(xcpt_t handler, FAR void *arg) {
+#if defined(CONFIG_JOSH_SAMPLING)
+  return stm32_sampling_attach(JOSH_SAMPLE_MAG, handler, arg);
+#elif defined(CONFIG_JOSH_MAG_COALESCE)
+  return stm32_mag_attach(handler, arg);
+#else
   int err = stm32_configgpio(GPIO_MAG_INT);
   if (err < 0) {
     return err;
   }
   return stm32_gpiosetevent(GPIO_MAG_INT, true, false, false, handler, arg);
+#endif
 }
 #endif
 
@@ -244,6 +268,21 @@ static void stm32_i2ctool(void) {
 int stm32_bringup(void) {
   int ret = OK;
 
+#ifdef HAVE_RTC_DRIVER
+  /* RTC first, so wall time is valid before any file system is mounted */
+
+  ret = stm32_rtc_initialize();
+  if (ret < 0) {
+    syslog(LOG_ERR, "Failed to register RTC driver: %d\n", ret);
+  }
+#endif
+
+#ifdef CONFIG_JOSH_SERIAL_DMAPOLL
+  /* Before anything talks to the GNSS or the RN2483 over DMA */
+
+  stm32_dmapoll_initialize();
+#endif
+
   /* I2C device drivers */
 
 #if defined(CONFIG_I2C) && defined(CONFIG_SYSTEM_I2CTOOL)
@@ -258,11 +297,34 @@ int stm32_bringup(void) {
   if (ret < 0) {
     syslog(LOG_ERR, "Could not register EEPROM driver: %d.\n", ret);
   }
+
+#ifdef CONFIG_JOSH_CALIB
+  /* Board calibration, loaded once so nothing recalibrates at startup */
+
+  ret = stm32_calib_initialize();
+  if (ret < 0) {
+    syslog(LOG_ERR, "Failed to load calibration, using defaults: %d\n", ret);
+  }
+#endif
+
+#ifdef CONFIG_JOSH_EECONFIG
+  ret = stm32_eeconfig_initialize();
+  if (ret < 0) {
+    syslog(LOG_ERR, "No stored configuration, starting erased: %d\n", ret);
+  }
+#endif
 #endif
 
   /* Sensor drivers */
 
-#if defined(CONFIG_SENSORS_MS56XX)
+#if defined(CONFIG_JOSH_BARO_PIPELINE)
+  /* MS5607 at 0x76 on I2C bus 1, timer-driven conversions */
+
+  ret = stm32_baro_initialize(0);
+  if (ret < 0) {
+    syslog(LOG_ERR, "Failed to register MS5607: %d\n", ret);
+  }
+#elif defined(CONFIG_SENSORS_MS56XX)
   /* MS56XX at 0x76 on I2C bus 1 */
 
   ret = ms56xx_register(stm32_i2cbus_initialize(1), 0, MS56XX_ADDR1,
@@ -309,20 +371,54 @@ int stm32_bringup(void) {
   if (ret < 0) {
     syslog(LOG_ERR, "Failed to register LIS2MDL: %d\n", ret);
   }
+
+#ifdef CONFIG_JOSH_MAG_CONFIGURE
+  if (ret >= 0) {
+    ret = stm32_mag_configure();
+    if (ret < 0) {
+      syslog(LOG_ERR, "Failed to configure LIS2MDL: %d\n", ret);
+    }
+  }
+#endif
+#endif
+
+#ifdef CONFIG_JOSH_SAMPLING
+  /* All sensors are attached, start triggering them from the common time
+   * base. The data-ready EXTI lines are left unconfigured in this mode.
+   */
+
+  ret = stm32_sampling_start();
+  if (ret < 0) {
+    syslog(LOG_ERR, "Failed to start sampling timer: %d\n", ret);
+  }
 #endif
 
 #if defined(CONFIG_SENSORS_L86_XXX)
   /* Register L86-M33 on USART3 */
 
+#ifdef CONFIG_JOSH_GNSS_SETUP
+  ret = stm32_gnss_setup();
+  if (ret < 0) {
+    syslog(LOG_ERR, "Failed to set up L86-M33 link: %d\n", ret);
+  }
+#endif
+
   ret = l86xxx_register("/dev/ttyS2", 0);
   if (ret < 0) {
     syslog(LOG_ERR, "Failed to register L86-M33: %d\n", ret);
   }
 #endif
 
+#ifdef CONFIG_JOSH_PPS
+  ret = stm32_pps_initialize();
+  if (ret < 0) {
+    syslog(LOG_ERR, "Failed to start GNSS PPS capture: %d\n", ret);
+  }
+#endif
+
 #ifdef CONFIG_LPWAN_RN2XX3
 
-#if CONFIG_USART2_BAUD != 57600
+#if CONFIG_USART2_BAUD != 57600 && !defined(CONFIG_JOSH_RADIO_AUTOBAUD)
 #error "CONFIG_USART2_BAUD must be set to 57600 for RN2XX3"
 #endif
 
@@ -330,12 +426,28 @@ int stm32_bringup(void) {
 #error "CONFIG_STANDARD_SERIAL must be enabled for RN2XX3"
 #endif /* CONFIG_STANDARD_SERIAL */
 
+#ifdef CONFIG_JOSH_RADIO_AUTOBAUD
+  /* Speed up the link before the driver starts talking to the module */
+
+  ret = stm32_rn2483_autobaud();
+  if (ret < 0) {
+    syslog(LOG_ERR, "RN2483 autobaud failed: %d\n", ret);
+  }
+#endif
+
   /* Register the RN2XX3 device driver */
 
   ret = rn2xx3_register("/dev/rn2483", "/dev/ttyS1");
   if (ret < 0) {
     syslog(LOG_ERR, "Failed to register RN2XX3 device driver: %d\n", ret);
   }
+
+#ifdef CONFIG_JOSH_RADIO
+  ret = stm32_radio_initialize();
+  if (ret < 0) {
+    syslog(LOG_ERR, "Failed to start radio queue: %d\n", ret);
+  }
+#endif
 #endif
 
 #ifdef CONFIG_FS_PROCFS
@@ -390,6 +502,52 @@ int stm32_bringup(void) {
 
 #endif
 
+#ifdef CONFIG_JOSH_COMPOSITE
+  /* After the SD card, whose partitions are exported as mass storage */
+
+  ret = stm32_composite_initialize();
+  if (ret < 0) {
+    syslog(LOG_ERR, "Failed to start composite USB device: %d\n", ret);
+  }
+#elif defined(CONFIG_JOSH_OFFLOAD)
+  /* The offload service owns the CDC-ACM port */
+
+  ret = cdcacm_initialize(0, NULL);
+  if (ret < 0) {
+    syslog(LOG_ERR, "Failed to register CDC-ACM device: %d\n", ret);
+  }
+#endif
+
+#ifdef CONFIG_JOSH_USBPM
+  ret = stm32_usbpm_initialize();
+  if (ret < 0) {
+    syslog(LOG_ERR, "Failed to start USB power management: %d\n", ret);
+  }
+#endif
+
+#ifdef CONFIG_JOSH_OFFLOAD
+  ret = stm32_offload_initialize();
+  if (ret < 0) {
+    syslog(LOG_ERR, "Failed to start USB offload: %d\n", ret);
+  }
+#endif
+
+#ifdef HAVE_USBHOST
+  /* After the SD card, so a thumb drive can be used to back it up */
+
+  ret = stm32_usbhost_initialize();
+  if (ret < 0) {
+    syslog(LOG_ERR, "Failed to start USB host: %d\n", ret);
+  }
+#endif
+
+#ifdef CONFIG_JOSH_LEDSEQ
+  ret = stm32_ledseq_initialize();
+  if (ret < 0) {
+    syslog(LOG_ERR, "Failed to start LED sequencer: %d\n", ret);
+  }
+#endif
+
 #ifdef CONFIG_PWM
   ret = stm32_pwm_setup();
   if (ret < 0) {
@@ -397,6 +555,13 @@ int stm32_bringup(void) {
   }
 #endif
 
+#ifdef CONFIG_JOSH_TONE
+  ret = stm32_tone_initialize();
+  if (ret < 0) {
+    syslog(LOG_ERR, "Failed to start tone sequencer: %d\n", ret);
+  }
+#endif
+
 #ifdef CONFIG_DEV_GPIO  
   stm32_dev_gpio_init();
 #endif
@@ -0,0 +1,314 @@
+/****************************************************************************
+ * boards/arm/stm32h7/josh/src/stm32_calib.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/crc32.h>
+#include <nuttx/mutex.h>
+#include <nuttx/fs/fs.h>
+#include <arch/board/board.h>
+
+#include "josh.h"
+
+#ifdef CONFIG_JOSH_CALIB
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define CALIB_DEVPATH      "/dev/eeprom"
+#define CALIB_MAGIC        0x4c41434a /* "JCAL" */
+
+/* Bump when fields are appended to struct josh_calib_s. Older images are
+ * still accepted: the fields they predate keep their defaults.
+ */
+
+#define CALIB_VERSION      1
+
+#if CONFIG_JOSH_CALIB_OFFSET + JOSH_CALIB_SIZE > JOSH_EEPROM_SIZE
+#  error "CONFIG_JOSH_CALIB_OFFSET leaves no room for the calibration block"
+#endif
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct calib_header_s
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t length;   /* Bytes of calibration data following the header */
+  uint32_t crc;      /* CRC32 of the calibration data */
+};
+
+struct calib_image_s
+{
+  struct calib_header_s header;
+  struct josh_calib_s data;
+};
+
+static_assert(sizeof(struct calib_image_s) <= JOSH_CALIB_SIZE,
+              "Calibration block outgrew JOSH_CALIB_SIZE");
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct josh_calib_s g_calib;
+static mutex_t g_calib_lock = NXMUTEX_INITIALIZER;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: calib_defaults
+ *
+ * Description:
+ *   Nominal calibration, used for anything the EEPROM image does not hold.
+ *
+ ****************************************************************************/
+
+static void calib_defaults(FAR struct josh_calib_s *calib)
+{
+  memset(calib, 0, sizeof(*calib));
+
+#ifdef CONFIG_JOSH_ADC_PUBLISH
+  calib->adc[0].offset = CONFIG_JOSH_ADC_VBAT_OFFSET;
+  calib->adc[0].scale  = CONFIG_JOSH_ADC_VBAT_SCALE;
+  calib->adc[1].offset = CONFIG_JOSH_ADC_CURRENT_OFFSET;
+  calib->adc[1].scale  = CONFIG_JOSH_ADC_CURRENT_SCALE;
+#endif
+
+  calib->mag_soft[0][0] = 1.0f;
+  calib->mag_soft[1][1] = 1.0f;
+  calib->mag_soft[2][2] = 1.0f;
+}
+
+/****************************************************************************
+ * Name: calib_apply
+ *
+ * Description:
+ *   Push the calibration terms the board consumes itself to their drivers.
+ *   The IMU and magnetometer terms are applied by the flight software,
+ *   which reads them with BIOC_CALIB_GET.
+ *
+ ****************************************************************************/
+
+static void calib_apply(FAR const struct josh_calib_s *calib)
+{
+#ifdef CONFIG_JOSH_ADC_PUBLISH
+  int i;
+
+  for (i = 0; i < JOSH_CALIB_NADC; i++)
+    {
+      stm32_adc_calibrate(i, calib->adc[i].offset, calib->adc[i].scale);
+    }
+#endif
+}
+
+/****************************************************************************
+ * Name: calib_read
+ *
+ * Description:
+ *   Read and validate the calibration image. Fields newer than the stored
+ *   version are left as they are in 'calib'.
+ *
+ ****************************************************************************/
+
+static int calib_read(FAR struct josh_calib_s *calib)
+{
+  struct calib_image_s image;
+  struct file filep;
+  ssize_t nread;
+  int ret;
+
+  ret = file_open(&filep, CALIB_DEVPATH, O_RDONLY);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  ret = file_seek(&filep, CONFIG_JOSH_CALIB_OFFSET, SEEK_SET);
+  if (ret < 0)
+    {
+      goto errout;
+    }
+
+  nread = file_read(&filep, &image, sizeof(image));
+  if (nread != sizeof(image))
+    {
+      ret = nread < 0 ? nread : -EIO;
+      goto errout;
+    }
+
+  if (image.header.magic != CALIB_MAGIC ||
+      image.header.version > CALIB_VERSION ||
+      image.header.length > sizeof(image.data))
+    {
+      ret = -ENOENT;
+      goto errout;
+    }
+
+  if (crc32((FAR const uint8_t *)&image.data, image.header.length) !=
+      image.header.crc)
+    {
+      ret = -EBADMSG;
+      goto errout;
+    }
+
+  memcpy(calib, &image.data, image.header.length);
+  ret = OK;
+
+errout:
+  file_close(&filep);
+  return ret;
+}
+
+/****************************************************************************
+ * Name: calib_write
+ ****************************************************************************/
+
+static int calib_write(FAR const struct josh_calib_s *calib)
+{
+  struct calib_image_s image;
+  struct file filep;
+  ssize_t nwritten;
+  int ret;
+
+  image.header.magic   = CALIB_MAGIC;
+  image.header.version = CALIB_VERSION;
+  image.header.length  = sizeof(image.data);
+  memcpy(&image.data, calib, sizeof(image.data));
+  image.header.crc     = crc32((FAR const uint8_t *)&image.data,
+                               sizeof(image.data));
+
+  ret = file_open(&filep, CALIB_DEVPATH, O_WRONLY);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  ret = file_seek(&filep, CONFIG_JOSH_CALIB_OFFSET, SEEK_SET);
+  if (ret >= 0)
+    {
+      nwritten = file_write(&filep, &image, sizeof(image));
+      if (nwritten != sizeof(image))
+        {
+          ret = nwritten < 0 ? nwritten : -EIO;
+        }
+    }
+
+  file_close(&filep);
+  return ret;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: stm32_calib_initialize
+ *
+ * Description:
+ *   Load the board calibration from the EEPROM into RAM, falling back to
+ *   nominal values if there is no valid image. Must be called after the
+ *   EEPROM driver is registered.
+ *
+ ****************************************************************************/
+
+int stm32_calib_initialize(void)
+{
+  int ret;
+
+  calib_defaults(&g_calib);
+
+  ret = calib_read(&g_calib);
+  if (ret < 0)
+    {
+      _warn("No valid calibration in %s (%d), using defaults\n",
+            CALIB_DEVPATH, ret);
+    }
+
+  calib_apply(&g_calib);
+  return ret;
+}
+
+/****************************************************************************
+ * Name: stm32_calib_get
+ ****************************************************************************/
+
+int stm32_calib_get(FAR struct josh_calib_s *calib)
+{
+  int ret;
+
+  ret = nxmutex_lock(&g_calib_lock);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  memcpy(calib, &g_calib, sizeof(*calib));
+  nxmutex_unlock(&g_calib_lock);
+  return OK;
+}
+
+/****************************************************************************
+ * Name: stm32_calib_set
+ *
+ * Description:
+ *   Store a new calibration in the EEPROM and apply it. The RAM copy is
+ *   only replaced once the EEPROM write has succeeded.
+ *
+ ****************************************************************************/
+
+int stm32_calib_set(FAR const struct josh_calib_s *calib)
+{
+  int ret;
+
+  ret = nxmutex_lock(&g_calib_lock);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  ret = calib_write(calib);
+  if (ret >= 0)
+    {
+      memcpy(&g_calib, calib, sizeof(g_calib));
+      calib_apply(&g_calib);
+    }
+
+  nxmutex_unlock(&g_calib_lock);
+  return ret;
+}
+
+#endif /* CONFIG_JOSH_CALIB */
@@ -0,0 +1,253 @@
+/****************************************************************************
+ * boards/arm/stm32h7/josh/src/stm32_composite.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/* Composite USB device for bench work:
+ *
+ *   /dev/ttyACM0  NSH console
+ *   /dev/ttyACM1  data port: file offload and live sensor stream
+ *   mass storage  the two SD card partitions, read-only by default
+ *
+ * The OTG FS core has eight endpoints besides EP0, which is exactly three
+ * per CDC-ACM function and two for mass storage.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdbool.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/board.h>
+#include <nuttx/usb/usbdev.h>
+#include <nuttx/usb/cdcacm.h>
+#include <nuttx/usb/usbmsc.h>
+#include <nuttx/usb/composite.h>
+
+#include "josh.h"
+
+#ifdef CONFIG_JOSH_COMPOSITE
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define COMPOSITE_NACM     2
+#define COMPOSITE_NDEVS    (COMPOSITE_NACM + 1)
+#define COMPOSITE_NLUNS    2
+
+#ifdef CONFIG_JOSH_COMPOSITE_MSC_RW
+#  define COMPOSITE_MSC_RO false
+#else
+#  define COMPOSITE_MSC_RO true
+#endif
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* SD card partitions exported as LUNs */
+
+static FAR const char *g_composite_luns[COMPOSITE_NLUNS] =
+{
+  "/dev/mmcsd0p0",  /* /mnt/usrfs */
+  "/dev/mmcsd0p1",  /* /mnt/pwrfs */
+};
+
+static FAR void *g_mschandle;
+static FAR void *g_composite;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: composite_msc_classobject
+ *
+ * Description:
+ *   Configure the mass storage class and bind the SD card partitions when
+ *   the composite driver asks for its class object.
+ *
+ ****************************************************************************/
+
+static int composite_msc_classobject(int minor,
+                                     FAR struct usbdev_devinfo_s *devinfo,
+                                     FAR struct usbdevclass_driver_s
+                                     **classdev)
+{
+  int ret;
+  int i;
+
+  DEBUGASSERT(g_mschandle == NULL);
+
+  ret = usbmsc_configure(COMPOSITE_NLUNS, &g_mschandle);
+  if (ret < 0)
+    {
+      uerr("ERROR: usbmsc_configure failed: %d\n", ret);
+      return ret;
+    }
+
+  /* A partition that is missing only costs its LUN */
+
+  for (i = 0; i < COMPOSITE_NLUNS; i++)
+    {
+      ret = usbmsc_bindlun(g_mschandle, g_composite_luns[i], i, 0, 0,
+                           COMPOSITE_MSC_RO);
+      if (ret < 0)
+        {
+          uwarn("WARNING: Failed to bind %s: %d\n",
+                g_composite_luns[i], ret);
+        }
+    }
+
+  ret = usbmsc_classobject(g_mschandle, devinfo, classdev);
+  if (ret < 0)
+    {
+      uerr("ERROR: usbmsc_classobject failed: %d\n", ret);
+      usbmsc_uninitialize(g_mschandle);
+      g_mschandle = NULL;
+    }
+
+  return ret;
+}
+
+/****************************************************************************
+ * Name: composite_msc_uninitialize
+ ****************************************************************************/
+
+static void composite_msc_uninitialize(FAR struct usbdevclass_driver_s
+                                       *classdev)
+{
+  if (g_mschandle != NULL)
+    {
+      usbmsc_uninitialize(g_mschandle);
+      g_mschandle = NULL;
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: board_composite_initialize
+ *
+ * Description:
+ *   Perform architecture specific initialization of a composite USB
+ *   device.
+ *
+ ****************************************************************************/
+
+int board_composite_initialize(int port)
+{
+  return OK;
+}
+
+/****************************************************************************
+ * Name: board_composite_connect
+ *
+ * Description:
+ *   Connect the two CDC-ACM functions and mass storage to the USB device
+ *   controller. A second call returns the handle from the first, as the
+ *   functions and their endpoints can only be bound once.
+ *
+ ****************************************************************************/
+
+FAR void *board_composite_connect(int port, int configid)
+{
+  struct composite_devdesc_s dev[COMPOSITE_NDEVS];
+  int ifnobase = 0;
+  int strbase = COMPOSITE_NSTRIDS;
+  int epno = 1;
+  int i;
+
+  if (port != 0 || configid != 0)
+    {
+      return NULL;
+    }
+
+  if (g_composite != NULL)
+    {
+      return g_composite;
+    }
+
+  for (i = 0; i < COMPOSITE_NACM; i++)
+    {
+      cdcacm_get_composite_devdesc(&dev[i]);
+
+      dev[i].minor            = i;
+      dev[i].devinfo.ifnobase = ifnobase;
+      dev[i].devinfo.strbase  = strbase;
+
+      dev[i].devinfo.epno[CDCACM_EP_INTIN_IDX]   = epno++;
+      dev[i].devinfo.epno[CDCACM_EP_BULKIN_IDX]  = epno++;
+      dev[i].devinfo.epno[CDCACM_EP_BULKOUT_IDX] = epno++;
+
+      ifnobase += dev[i].devinfo.ninterfaces;
+      strbase  += dev[i].devinfo.nstrings;
+    }
+
+  usbmsc_get_composite_devdesc(&dev[i]);
+
+  dev[i].classobject      = composite_msc_classobject;
+  dev[i].uninitialize     = composite_msc_uninitialize;
+  dev[i].minor            = 0;
+  dev[i].devinfo.ifnobase = ifnobase;
+  dev[i].devinfo.strbase  = strbase;
+
+  dev[i].devinfo.epno[USBMSC_EP_BULKIN_IDX]  = epno++;
+  dev[i].devinfo.epno[USBMSC_EP_BULKOUT_IDX] = epno++;
+
+  g_composite = composite_initialize(composite_getdevdescs(), dev,
+                                    COMPOSITE_NDEVS);
+  return g_composite;
+}
+
+/****************************************************************************
+ * Name: stm32_composite_initialize
+ *
+ * Description:
+ *   Bring up the composite USB device. Must be called after the SD card
+ *   partitions are registered.
+ *
+ ****************************************************************************/
+
+int stm32_composite_initialize(void)
+{
+  int ret;
+
+  if (g_composite != NULL)
+    {
+      return -EBUSY;
+    }
+
+  ret = board_composite_initialize(0);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  return board_composite_connect(0, 0) != NULL ? OK : -ENODEV;
+}
+
+#endif /* CONFIG_JOSH_COMPOSITE */
@@ -0,0 +1,77 @@
+/****************************************************************************
+ * boards/arm/stm32h7/josh/src/stm32_dmapoll.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <nuttx/clock.h>
+#include <nuttx/wdog.h>
+
+#include "stm32_uart.h"
+#include "josh.h"
+
+#ifdef CONFIG_JOSH_SERIAL_DMAPOLL
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct wdog_s g_dmapoll;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: dmapoll_expired
+ *
+ * Description:
+ *   The serial receive DMA only interrupts at half and full buffer. Flush
+ *   partially filled buffers of every DMA-driven UART periodically, so a
+ *   short reply or NMEA sentence is delivered shortly after its last byte
+ *   arrives, without an interrupt per received byte.
+ *
+ ****************************************************************************/
+
+static void dmapoll_expired(wdparm_t arg)
+{
+  stm32_serial_dma_poll();
+  wd_start(&g_dmapoll, MSEC2TICK(CONFIG_JOSH_SERIAL_DMAPOLL_MS),
+           dmapoll_expired, 0);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: stm32_dmapoll_initialize
+ ****************************************************************************/
+
+void stm32_dmapoll_initialize(void)
+{
+  wd_start(&g_dmapoll, MSEC2TICK(CONFIG_JOSH_SERIAL_DMAPOLL_MS),
+           dmapoll_expired, 0);
+}
+
+#endif /* CONFIG_JOSH_SERIAL_DMAPOLL */
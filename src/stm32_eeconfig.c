@@ -0,0 +1,431 @@
+/****************************************************************************
+ * boards/arm/stm32h7/josh/src/stm32_eeconfig.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/* Configuration store in front of the M24C32.
+ *
+ * The configuration lives in a RAM shadow. Reads and writes only touch the
+ * shadow; writes mark the pages they change and schedule a delayed flush on
+ * the low priority work queue, so a burst of writes becomes one EEPROM
+ * update.
+ *
+ * The EEPROM region holds CONFIG_JOSH_EECONFIG_NSLOTS slots. Each flush goes
+ * to the slot after the last committed one, spreading wear across them. A
+ * slot is one header page followed by the data pages:
+ *
+ *   page 0:     magic, sequence number, CRC32 of the data
+ *   page 1..N:  configuration data
+ *
+ * Every slot keeps its own dirty-page mask, so a flush only rewrites the
+ * pages that changed since that slot was last written. The header page is
+ * written last; a flush interrupted by a reset leaves a slot with a bad CRC
+ * and the previous slot is used at the next boot.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/irq.h>
+#include <nuttx/clock.h>
+#include <nuttx/crc32.h>
+#include <nuttx/wqueue.h>
+#include <nuttx/fs/fs.h>
+
+#include "josh.h"
+
+#ifdef CONFIG_JOSH_EECONFIG
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define EECONFIG_DEVPATH   "/dev/eeprom"
+#define EECONFIG_MAGIC     0x4643454a /* "JECF" */
+
+/* M24C32 write page */
+
+#define EECONFIG_PAGE      32
+
+#define EECONFIG_NPAGES    CONFIG_JOSH_EECONFIG_PAGES
+#define EECONFIG_NSLOTS    CONFIG_JOSH_EECONFIG_NSLOTS
+#define EECONFIG_DATASIZE  (EECONFIG_NPAGES * EECONFIG_PAGE)
+#define EECONFIG_SLOTSIZE  ((EECONFIG_NPAGES + 1) * EECONFIG_PAGE)
+#define EECONFIG_ALLPAGES  ((uint32_t)((1ull << EECONFIG_NPAGES) - 1))
+
+#define EECONFIG_SLOT(n)   (CONFIG_JOSH_EECONFIG_OFFSET + \
+                            (n) * EECONFIG_SLOTSIZE)
+
+#define EECONFIG_END       EECONFIG_SLOT(EECONFIG_NSLOTS)
+
+#if CONFIG_JOSH_EECONFIG_OFFSET % EECONFIG_PAGE != 0
+#  error "CONFIG_JOSH_EECONFIG_OFFSET must be page aligned"
+#endif
+
+#if EECONFIG_END > JOSH_EEPROM_SIZE
+#  error "JOSH_EECONFIG slots do not fit in the EEPROM"
+#endif
+
+#if defined(CONFIG_JOSH_CALIB) && \
+    CONFIG_JOSH_CALIB_OFFSET < EECONFIG_END && \
+    CONFIG_JOSH_CALIB_OFFSET + JOSH_CALIB_SIZE > CONFIG_JOSH_EECONFIG_OFFSET
+#  error "JOSH_EECONFIG slots overlap the calibration block"
+#endif
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct eeconfig_header_s
+{
+  uint32_t magic;
+  uint32_t seq;      /* Incremented on every flush */
+  uint32_t crc;      /* CRC32 of the data pages */
+  uint8_t reserved[EECONFIG_PAGE - 12];
+};
+
+struct eeconfig_s
+{
+  struct work_s work;                         /* Delayed flush */
+  uint8_t shadow[EECONFIG_DATASIZE];          /* Current configuration */
+  uint8_t flush[EECONFIG_DATASIZE];           /* Copy being written */
+  uint32_t dirty[EECONFIG_NSLOTS];            /* Pages stale in each slot */
+  uint32_t seq;                               /* Last committed sequence */
+  uint8_t slot;                               /* Last committed slot */
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct eeconfig_s g_eeconfig;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: eeconfig_io
+ ****************************************************************************/
+
+static int eeconfig_io(FAR struct file *filep, off_t offset, FAR void *buf,
+                       size_t len, bool write)
+{
+  ssize_t nxfer;
+  int ret;
+
+  ret = file_seek(filep, offset, SEEK_SET);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  nxfer = write ? file_write(filep, buf, len) : file_read(filep, buf, len);
+  if (nxfer != len)
+    {
+      return nxfer < 0 ? nxfer : -EIO;
+    }
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: eeconfig_worker
+ *
+ * Description:
+ *   Write the shadow to the next slot. Only pages stale in that slot are
+ *   written, followed by the header page that commits it.
+ *
+ ****************************************************************************/
+
+static void eeconfig_worker(FAR void *arg)
+{
+  FAR struct eeconfig_s *cfg = (FAR struct eeconfig_s *)arg;
+  struct eeconfig_header_s header;
+  struct file filep;
+  irqstate_t flags;
+  uint32_t dirty;
+  uint8_t slot;
+  int page;
+  int ret;
+
+  slot = (cfg->slot + 1) % EECONFIG_NSLOTS;
+
+  /* Writes that land while the EEPROM is busy mark the pages stale again
+   * and are picked up by the next flush.
+   */
+
+  flags = enter_critical_section();
+  memcpy(cfg->flush, cfg->shadow, EECONFIG_DATASIZE);
+  dirty = cfg->dirty[slot];
+  cfg->dirty[slot] = 0;
+  leave_critical_section(flags);
+
+  ret = file_open(&filep, EECONFIG_DEVPATH, O_WRONLY);
+  if (ret < 0)
+    {
+      goto errout;
+    }
+
+  for (page = 0; page < EECONFIG_NPAGES && ret >= 0; page++)
+    {
+      if ((dirty & (1 << page)) != 0)
+        {
+          ret = eeconfig_io(&filep,
+                            EECONFIG_SLOT(slot) + (page + 1) * EECONFIG_PAGE,
+                            &cfg->flush[page * EECONFIG_PAGE],
+                            EECONFIG_PAGE, true);
+        }
+    }
+
+  if (ret >= 0)
+    {
+      memset(&header, 0xff, sizeof(header));
+      header.magic = EECONFIG_MAGIC;
+      header.seq   = cfg->seq + 1;
+      header.crc   = crc32(cfg->flush, EECONFIG_DATASIZE);
+
+      ret = eeconfig_io(&filep, EECONFIG_SLOT(slot), &header,
+                        sizeof(header), true);
+    }
+
+  file_close(&filep);
+
+  if (ret >= 0)
+    {
+      cfg->slot = slot;
+      cfg->seq++;
+      return;
+    }
+
+errout:
+  ferr("ERROR: Config flush to slot %d failed: %d\n", slot, ret);
+
+  flags = enter_critical_section();
+  cfg->dirty[slot] |= dirty;
+  leave_critical_section(flags);
+
+  work_queue(LPWORK, &cfg->work, eeconfig_worker, cfg,
+             MSEC2TICK(CONFIG_JOSH_EECONFIG_FLUSH_MS));
+}
+
+/****************************************************************************
+ * Name: eeconfig_load
+ *
+ * Description:
+ *   Load the valid slot with the highest sequence number into the shadow.
+ *
+ ****************************************************************************/
+
+static int eeconfig_load(FAR struct eeconfig_s *cfg)
+{
+  struct eeconfig_header_s header;
+  struct file filep;
+  bool found = false;
+  int slot;
+  int ret;
+
+  ret = file_open(&filep, EECONFIG_DEVPATH, O_RDONLY);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  for (slot = 0; slot < EECONFIG_NSLOTS; slot++)
+    {
+      ret = eeconfig_io(&filep, EECONFIG_SLOT(slot), &header,
+                        sizeof(header), false);
+      if (ret < 0 || header.magic != EECONFIG_MAGIC ||
+          (found && (int32_t)(header.seq - cfg->seq) <= 0))
+        {
+          continue;
+        }
+
+      ret = eeconfig_io(&filep, EECONFIG_SLOT(slot) + EECONFIG_PAGE,
+                        cfg->flush, EECONFIG_DATASIZE, false);
+      if (ret < 0 || crc32(cfg->flush, EECONFIG_DATASIZE) != header.crc)
+        {
+          continue;
+        }
+
+      memcpy(cfg->shadow, cfg->flush, EECONFIG_DATASIZE);
+      cfg->seq  = header.seq;
+      cfg->slot = slot;
+      found     = true;
+    }
+
+  file_close(&filep);
+  return found ? OK : -ENOENT;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: stm32_eeconfig_initialize
+ *
+ * Description:
+ *   Load the configuration from the newest valid EEPROM slot. With no valid
+ *   slot the configuration starts erased (all 0xff). Must be called after
+ *   the EEPROM driver is registered.
+ *
+ ****************************************************************************/
+
+int stm32_eeconfig_initialize(void)
+{
+  FAR struct eeconfig_s *cfg = &g_eeconfig;
+  int slot;
+  int ret;
+
+  memset(cfg->shadow, 0xff, EECONFIG_DATASIZE);
+  cfg->slot = EECONFIG_NSLOTS - 1;
+  cfg->seq  = 0;
+
+  ret = eeconfig_load(cfg);
+  if (ret < 0)
+    {
+      memset(cfg->shadow, 0xff, EECONFIG_DATASIZE);
+    }
+
+  /* The contents of the other slots are unknown, so rewrite them in full
+   * the first time each is used.
+   */
+
+  for (slot = 0; slot < EECONFIG_NSLOTS; slot++)
+    {
+      cfg->dirty[slot] = slot == cfg->slot && ret >= 0 ?
+                         0 : EECONFIG_ALLPAGES;
+    }
+
+  return ret;
+}
+
+/****************************************************************************
+ * Name: stm32_eeconfig_read
+ *
+ * Description:
+ *   Copy configuration bytes out of the RAM shadow.
+ *
+ ****************************************************************************/
+
+int stm32_eeconfig_read(size_t offset, FAR void *buf, size_t len)
+{
+  irqstate_t flags;
+
+  if (offset > EECONFIG_DATASIZE || len > EECONFIG_DATASIZE - offset)
+    {
+      return -EINVAL;
+    }
+
+  flags = enter_critical_section();
+  memcpy(buf, &g_eeconfig.shadow[offset], len);
+  leave_critical_section(flags);
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: stm32_eeconfig_write
+ *
+ * Description:
+ *   Update configuration bytes in the RAM shadow and schedule a flush.
+ *   Never waits for the EEPROM; writes made before the flush runs are
+ *   written together.
+ *
+ ****************************************************************************/
+
+int stm32_eeconfig_write(size_t offset, FAR const void *buf, size_t len)
+{
+  FAR struct eeconfig_s *cfg = &g_eeconfig;
+  irqstate_t flags;
+  uint32_t pages;
+  int first;
+  int last;
+  int slot;
+
+  if (offset > EECONFIG_DATASIZE || len > EECONFIG_DATASIZE - offset)
+    {
+      return -EINVAL;
+    }
+
+  if (len == 0)
+    {
+      return OK;
+    }
+
+  first = offset / EECONFIG_PAGE;
+  last  = (offset + len - 1) / EECONFIG_PAGE;
+  pages = ((1ull << (last + 1)) - 1) & ~((1ull << first) - 1);
+
+  flags = enter_critical_section();
+  if (memcmp(&cfg->shadow[offset], buf, len) == 0)
+    {
+      leave_critical_section(flags);
+      return OK;
+    }
+
+  memcpy(&cfg->shadow[offset], buf, len);
+  for (slot = 0; slot < EECONFIG_NSLOTS; slot++)
+    {
+      cfg->dirty[slot] |= pages;
+    }
+
+  leave_critical_section(flags);
+
+  if (work_available(&cfg->work))
+    {
+      work_queue(LPWORK, &cfg->work, eeconfig_worker, cfg,
+                 MSEC2TICK(CONFIG_JOSH_EECONFIG_FLUSH_MS));
+    }
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: stm32_eeconfig_commit
+ *
+ * Description:
+ *   Move a pending flush up to run as soon as LPWORK gets to it, for
+ *   changes that must survive a reset shortly after they are made. Never
+ *   waits for the EEPROM.
+ *
+ ****************************************************************************/
+
+void stm32_eeconfig_commit(void)
+{
+  FAR struct eeconfig_s *cfg = &g_eeconfig;
+
+  if (!work_available(&cfg->work))
+    {
+      work_cancel(LPWORK, &cfg->work);
+      work_queue(LPWORK, &cfg->work, eeconfig_worker, cfg, 0);
+    }
+}
+
+#endif /* CONFIG_JOSH_EECONFIG */
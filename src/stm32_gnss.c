@@ -0,0 +1,336 @@
+/****************************************************************************
+ * boards/arm/stm32h7/josh/src/stm32_gnss.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <debug.h>
+#include <termios.h>
+
+#include <sys/param.h>
+
+#include <nuttx/clock.h>
+#include <nuttx/signal.h>
+#include <nuttx/fs/fs.h>
+
+#include "josh.h"
+
+#ifdef CONFIG_JOSH_GNSS_SETUP
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define GNSS_DEVPATH       "/dev/ttyS2"
+
+/* The L86 outputs a full set of sentences at least once per second at its
+ * default 1Hz fix rate, so listen a little longer than that per baud.
+ */
+
+#define GNSS_PROBE_MS      1200
+#define GNSS_POLL_MS       10
+#define GNSS_CMD_MAX       32
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Baud rates to try, most likely first. The L86 ships at 9600. */
+
+static const speed_t g_gnss_bauds[] =
+{
+  CONFIG_L86_XXX_BAUD, 9600, 115200, 57600, 38400, 19200,
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gnss_hexval
+ ****************************************************************************/
+
+static int gnss_hexval(char c)
+{
+  if (c >= '0' && c <= '9')
+    {
+      return c - '0';
+    }
+  else if (c >= 'A' && c <= 'F')
+    {
+      return c - 'A' + 10;
+    }
+
+  return -1;
+}
+
+/****************************************************************************
+ * Name: gnss_find_sentence
+ *
+ * Description:
+ *   Locate the first complete, checksum-valid NMEA sentence in 'buf'. The
+ *   sentence is reported as offsets into the caller's buffer so nothing is
+ *   copied.
+ *
+ * Returned Value:
+ *   true if a sentence spanning buf[*start] to buf[*end - 1] was found.
+ *
+ ****************************************************************************/
+
+static bool gnss_find_sentence(FAR const char *buf, size_t len,
+                               FAR size_t *start, FAR size_t *end)
+{
+  uint8_t sum;
+  size_t i;
+  size_t j;
+  int hi;
+  int lo;
+
+  for (i = 0; i < len; i++)
+    {
+      if (buf[i] != '$')
+        {
+          continue;
+        }
+
+      sum = 0;
+      for (j = i + 1; j < len && buf[j] != '*' && buf[j] != '$'; j++)
+        {
+          sum ^= (uint8_t)buf[j];
+        }
+
+      if (j + 2 >= len || buf[j] != '*')
+        {
+          continue;
+        }
+
+      hi = gnss_hexval(buf[j + 1]);
+      lo = gnss_hexval(buf[j + 2]);
+      if (hi >= 0 && lo >= 0 && ((hi << 4) | lo) == sum)
+        {
+          *start = i;
+          *end   = j + 3;
+          return true;
+        }
+    }
+
+  return false;
+}
+
+/****************************************************************************
+ * Name: gnss_setbaud
+ ****************************************************************************/
+
+static int gnss_setbaud(FAR struct file *filep, speed_t baud)
+{
+  struct termios tio;
+  int ret;
+
+  ret = file_ioctl(filep, TCGETS, (unsigned long)&tio);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  cfsetspeed(&tio, baud);
+  ret = file_ioctl(filep, TCSETS, (unsigned long)&tio);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  /* Discard anything received at the old rate */
+
+  return file_ioctl(filep, TCFLSH, TCIFLUSH);
+}
+
+/****************************************************************************
+ * Name: gnss_listen
+ *
+ * Description:
+ *   Listen for up to GNSS_PROBE_MS for a valid NMEA sentence at the current
+ *   baud rate.
+ *
+ ****************************************************************************/
+
+static bool gnss_listen(FAR struct file *filep)
+{
+  char buf[128];
+  size_t start;
+  size_t end;
+  size_t len = 0;
+  ssize_t nread;
+  int waited;
+
+  for (waited = 0; waited < GNSS_PROBE_MS; waited += GNSS_POLL_MS)
+    {
+      nread = file_read(filep, &buf[len], sizeof(buf) - len);
+      if (nread > 0)
+        {
+          len += nread;
+          if (gnss_find_sentence(buf, len, &start, &end))
+            {
+              return true;
+            }
+
+          /* Keep only the tail, a sentence may straddle the boundary */
+
+          if (len == sizeof(buf))
+            {
+              memmove(buf, &buf[len / 2], len - len / 2);
+              len -= len / 2;
+            }
+        }
+
+      nxsig_usleep(GNSS_POLL_MS * USEC_PER_MSEC);
+    }
+
+  return false;
+}
+
+/****************************************************************************
+ * Name: gnss_command
+ *
+ * Description:
+ *   Send a PMTK command, adding the framing and checksum.
+ *
+ ****************************************************************************/
+
+static int gnss_command(FAR struct file *filep, FAR const char *fmt, int arg)
+{
+  char body[GNSS_CMD_MAX];
+  char cmd[GNSS_CMD_MAX + 8];
+  uint8_t sum = 0;
+  ssize_t nwritten;
+  int len;
+  int i;
+
+  snprintf(body, sizeof(body), fmt, arg);
+  for (i = 0; body[i] != '\0'; i++)
+    {
+      sum ^= (uint8_t)body[i];
+    }
+
+  len = snprintf(cmd, sizeof(cmd), "$%s*%02X\r\n", body, sum);
+  nwritten = file_write(filep, cmd, len);
+  if (nwritten < 0)
+    {
+      return nwritten;
+    }
+
+  sninfo("Sent %s", cmd);
+  return OK;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: stm32_gnss_setup
+ *
+ * Description:
+ *   Find the baud rate the L86 is currently using, switch it to
+ *   CONFIG_L86_XXX_BAUD and set the fix rate. Must be called before the
+ *   L86 driver is registered on USART3.
+ *
+ ****************************************************************************/
+
+int stm32_gnss_setup(void)
+{
+  struct file filep;
+  bool found = false;
+  int ret;
+  int i;
+
+  ret = file_open(&filep, GNSS_DEVPATH, O_RDWR | O_NONBLOCK);
+  if (ret < 0)
+    {
+      snerr("ERROR: Failed to open %s: %d\n", GNSS_DEVPATH, ret);
+      return ret;
+    }
+
+  for (i = 0; i < nitems(g_gnss_bauds) && !found; i++)
+    {
+      ret = gnss_setbaud(&filep, g_gnss_bauds[i]);
+      if (ret < 0)
+        {
+          goto errout;
+        }
+
+      found = gnss_listen(&filep);
+    }
+
+  if (!found)
+    {
+      snerr("ERROR: No NMEA output from L86 at any baud rate\n");
+      ret = -ENODEV;
+      goto errout;
+    }
+
+  i--;
+  sninfo("L86 found at %d baud\n", (int)g_gnss_bauds[i]);
+
+  if (g_gnss_bauds[i] != CONFIG_L86_XXX_BAUD)
+    {
+      ret = gnss_command(&filep, "PMTK251,%d", CONFIG_L86_XXX_BAUD);
+      if (ret < 0)
+        {
+          goto errout;
+        }
+
+      /* Let the command drain at the old rate before switching */
+
+      nxsig_usleep(100 * USEC_PER_MSEC);
+      ret = gnss_setbaud(&filep, CONFIG_L86_XXX_BAUD);
+      if (ret < 0)
+        {
+          goto errout;
+        }
+
+      if (!gnss_listen(&filep))
+        {
+          snerr("ERROR: L86 did not switch to %d baud\n",
+                CONFIG_L86_XXX_BAUD);
+          ret = -EIO;
+          goto errout;
+        }
+    }
+
+  /* Fix interval in milliseconds */
+
+  ret = gnss_command(&filep, "PMTK220,%d",
+                     1000 / CONFIG_JOSH_GNSS_FIX_RATE);
+
+errout:
+  file_close(&filep);
+  return ret;
+}
+
+#endif /* CONFIG_JOSH_GNSS_SETUP */
@@ -27,7 +27,9 @@
 #include <nuttx/config.h>
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <assert.h>
+#include <errno.h>
 #include <debug.h>
 
 #include <nuttx/clock.h>
@@ -36,12 +38,20 @@
 
 #include <arch/board/board.h>
 
+#include "arm_internal.h"
 #include "chip.h"
 #include "stm32_gpio.h"
 #include "josh.h"
 
 
 #if defined(CONFIG_DEV_GPIO)
+/****************************************************************************
+* Pre-processor Definitions
+****************************************************************************/
+
+#define GPIO_PORTNO(p)  (((p) & GPIO_PORT_MASK) >> GPIO_PORT_SHIFT)
+#define GPIO_PINNO(p)   (((p) & GPIO_PIN_MASK) >> GPIO_PIN_SHIFT)
+
 /****************************************************************************
 * Private Types
 ****************************************************************************/
@@ -62,13 +72,34 @@ struct stm32gpint_dev_s
 * Private Function Prototypes
 ****************************************************************************/
 
+#if BOARD_NGPIOIN > 0
+static int gpin_read(struct gpio_dev_s *dev, bool *value);
+#endif
 static int gpout_read(struct gpio_dev_s *dev, bool *value);
 static int gpout_write(struct gpio_dev_s *dev, bool value);
+#if BOARD_NGPIOINT > 0
+static int gpint_read(struct gpio_dev_s *dev, bool *value);
+static int gpint_attach(struct gpio_dev_s *dev,
+                        pin_interrupt_t callback);
+static int gpint_enable(struct gpio_dev_s *dev, bool enable);
+static int gpint_setpintype(struct gpio_dev_s *dev,
+                            enum gpio_pintype_e pintype);
+#endif
 
 /****************************************************************************
 * Private Data
 ****************************************************************************/
 
+#if BOARD_NGPIOIN > 0
+static const struct gpio_operations_s gpin_ops =
+{
+  .go_read   = gpin_read,
+  .go_write  = NULL,
+  .go_attach = NULL,
+  .go_enable = NULL,
+};
+#endif
+
 static const struct gpio_operations_s gpout_ops =
 {
   .go_read   = gpout_read,
@@ -77,6 +108,27 @@ static const struct gpio_operations_s gpout_ops =
   .go_enable = NULL,
 };
 
+#if BOARD_NGPIOINT > 0
+static const struct gpio_operations_s gpint_ops =
+{
+  .go_read       = gpint_read,
+  .go_write      = NULL,
+  .go_attach     = gpint_attach,
+  .go_enable     = gpint_enable,
+  .go_setpintype = gpint_setpintype,
+};
+#endif
+
+#if BOARD_NGPIOIN
+/* This array maps the GPIO pins used as INPUT */
+
+static const uint32_t g_gpioinputs[BOARD_NGPIOIN] =
+{
+  GPIO_ARM_SW,
+};
+static struct stm32gpio_dev_s g_gpin[BOARD_NGPIOIN];
+#endif
+
 #if BOARD_NGPIOOUT
 /* This array maps the GPIO pins used as OUTPUT */
 
@@ -87,11 +139,64 @@ static const uint32_t g_gpiooutputs[BOARD_NGPIOOUT] =
 static struct stm32gpio_dev_s g_gpout[BOARD_NGPIOOUT];
 #endif
 
+#if BOARD_NGPIOINT
+/* This array maps the GPIO pins used as INTERRUPT INPUTS */
+
+static const uint32_t g_gpiointinputs[BOARD_NGPIOINT] =
+{
+  GPIO_BREAKWIRE,
+  GPIO_UMBILICAL,
+};
+static struct stm32gpint_dev_s g_gpint[BOARD_NGPIOINT];
+#endif
+
 
 /****************************************************************************
 * Private Functions
 ****************************************************************************/
 
+#if BOARD_NGPIOINT > 0
+static int stm32gpio_interrupt(int irq, void *context, void *arg)
+{
+  struct stm32gpint_dev_s *stm32gpint =
+    (struct stm32gpint_dev_s *)arg;
+
+  DEBUGASSERT(stm32gpint != NULL && stm32gpint->callback != NULL);
+  gpioinfo("Interrupt! callback=%p\n", stm32gpint->callback);
+
+#if defined(CONFIG_JOSH_USBPM) && defined(CONFIG_JOSH_INTERLOCKS)
+  /* A pulled umbilical raises no USB interrupt; leave the suspend low
+   * power state here instead of waiting for flight software.
+   */
+
+  if (g_gpiointinputs[stm32gpint->stm32gpio.id] == GPIO_UMBILICAL &&
+      stm32_gpioread(GPIO_UMBILICAL))
+    {
+      stm32_usbpm_resume();
+    }
+#endif
+
+  stm32gpint->callback(&stm32gpint->stm32gpio.gpio,
+                       stm32gpint->stm32gpio.id);
+  return OK;
+}
+#endif
+
+#if BOARD_NGPIOIN > 0
+static int gpin_read(struct gpio_dev_s *dev, bool *value)
+{
+  struct stm32gpio_dev_s *stm32gpio =
+    (struct stm32gpio_dev_s *)dev;
+
+  DEBUGASSERT(stm32gpio != NULL && value != NULL);
+  DEBUGASSERT(stm32gpio->id < BOARD_NGPIOIN);
+  gpioinfo("Reading...\n");
+
+  *value = stm32_gpioread(g_gpioinputs[stm32gpio->id]);
+  return OK;
+}
+#endif
+
 static int gpout_read(struct gpio_dev_s *dev, bool *value)
 {
   struct stm32gpio_dev_s *stm32gpio =
@@ -118,6 +223,107 @@ static int gpout_write(struct gpio_dev_s *dev, bool value)
   return OK;
 }
 
+#if BOARD_NGPIOINT > 0
+static int gpint_read(struct gpio_dev_s *dev, bool *value)
+{
+  struct stm32gpint_dev_s *stm32gpint =
+    (struct stm32gpint_dev_s *)dev;
+
+  DEBUGASSERT(stm32gpint != NULL && value != NULL);
+  DEBUGASSERT(stm32gpint->stm32gpio.id < BOARD_NGPIOINT);
+  gpioinfo("Reading int pin...\n");
+
+  *value = stm32_gpioread(g_gpiointinputs[stm32gpint->stm32gpio.id]);
+  return OK;
+}
+
+static int gpint_attach(struct gpio_dev_s *dev,
+                        pin_interrupt_t callback)
+{
+  struct stm32gpint_dev_s *stm32gpint =
+    (struct stm32gpint_dev_s *)dev;
+
+  gpioinfo("Attaching the callback\n");
+
+  /* Make sure the interrupt is disabled */
+
+  stm32_gpiosetevent(g_gpiointinputs[stm32gpint->stm32gpio.id], false,
+                     false, false, NULL, NULL);
+
+  gpioinfo("Attach %p\n", callback);
+  stm32gpint->callback = callback;
+  return OK;
+}
+
+static int gpint_enable(struct gpio_dev_s *dev, bool enable)
+{
+  struct stm32gpint_dev_s *stm32gpint =
+    (struct stm32gpint_dev_s *)dev;
+  enum gpio_pintype_e pintype = dev->gp_pintype;
+  uint32_t pinset = g_gpiointinputs[stm32gpint->stm32gpio.id];
+  bool rising;
+  bool falling;
+
+  if (enable && stm32gpint->callback != NULL)
+    {
+      gpioinfo("Enabling the interrupt\n");
+
+      /* High and low level types have no EXTI equivalent; they trigger on
+       * the edge into that level.
+       */
+
+      rising  = pintype == GPIO_INTERRUPT_PIN ||
+                pintype == GPIO_INTERRUPT_HIGH_PIN ||
+                pintype == GPIO_INTERRUPT_RISING_PIN ||
+                pintype == GPIO_INTERRUPT_BOTH_PIN;
+      falling = pintype == GPIO_INTERRUPT_LOW_PIN ||
+                pintype == GPIO_INTERRUPT_FALLING_PIN ||
+                pintype == GPIO_INTERRUPT_BOTH_PIN;
+
+      stm32_gpiosetevent(pinset, rising, falling, false,
+                         stm32gpio_interrupt, stm32gpint);
+    }
+  else
+    {
+      gpioinfo("Disable the interrupt\n");
+      stm32_gpiosetevent(pinset, false, false, false, NULL, NULL);
+    }
+
+  return OK;
+}
+
+static int gpint_setpintype(struct gpio_dev_s *dev,
+                            enum gpio_pintype_e pintype)
+{
+  if (pintype < GPIO_INTERRUPT_PIN || pintype >= GPIO_NPINTYPES)
+    {
+      return -EINVAL;
+    }
+
+  /* Takes effect the next time the interrupt is enabled */
+
+  dev->gp_pintype = pintype;
+  return OK;
+}
+#endif
+
+static uint16_t stm32gpio_portmask(const uint32_t *pins, int npins,
+                                   int port)
+{
+  uint16_t mask = 0;
+  int i;
+
+  for (i = 0; i < npins; i++)
+    {
+      if (GPIO_PORTNO(pins[i]) == port)
+        {
+          mask |= 1 << GPIO_PINNO(pins[i]);
+        }
+    }
+
+  return mask;
+}
+
 /****************************************************************************
 * Public Functions
 ****************************************************************************/
@@ -154,6 +360,97 @@ int stm32_dev_gpio_init(void)
       pincount++;
     }
 #endif
+
+#if BOARD_NGPIOIN > 0
+  for (i = 0; i < BOARD_NGPIOIN; i++)
+    {
+      /* Setup and register the GPIO pin */
+
+      g_gpin[i].gpio.gp_pintype = GPIO_INPUT_PIN;
+      g_gpin[i].gpio.gp_ops     = &gpin_ops;
+      g_gpin[i].id              = i;
+      gpio_pin_register(&g_gpin[i].gpio, pincount);
+
+      /* Configure the pin that will be used as input */
+
+      stm32_configgpio(g_gpioinputs[i]);
+
+      pincount++;
+    }
+#endif
+
+#if BOARD_NGPIOINT > 0
+  for (i = 0; i < BOARD_NGPIOINT; i++)
+    {
+      /* Setup and register the GPIO pin, interrupting on both edges */
+
+      g_gpint[i].stm32gpio.gpio.gp_pintype = GPIO_INTERRUPT_BOTH_PIN;
+      g_gpint[i].stm32gpio.gpio.gp_ops     = &gpint_ops;
+      g_gpint[i].stm32gpio.id              = i;
+      gpio_pin_register(&g_gpint[i].stm32gpio.gpio, pincount);
+
+      /* Configure the pin that will be used as interrupt input */
+
+      stm32_configgpio(g_gpiointinputs[i]);
+
+      pincount++;
+    }
+#endif
+
 return OK;
 }
+
+/****************************************************************************
+* Name: stm32_gpio_batch
+*
+* Description:
+*   Write the board's outputs on one port, then snapshot the levels of all
+*   its board pins from IDR. Outputs may be written and any board pin
+*   read. The write is a single BSRR store, but PD3 is the only output, so
+*   it only ever changes one pin.
+*
+****************************************************************************/
+
+int stm32_gpio_batch(struct josh_gpio_batch_s *batch)
+{
+  uint16_t outputs = 0;
+  uint16_t readable;
+  uint32_t base;
+
+  if (batch == NULL || batch->port >= STM32H7_NGPIO)
+    {
+      return -EINVAL;
+    }
+
+#if BOARD_NGPIOOUT > 0
+  outputs  = stm32gpio_portmask(g_gpiooutputs, BOARD_NGPIOOUT,
+                                batch->port);
+#endif
+  readable = outputs;
+#if BOARD_NGPIOIN > 0
+  readable |= stm32gpio_portmask(g_gpioinputs, BOARD_NGPIOIN, batch->port);
+#endif
+#if BOARD_NGPIOINT > 0
+  readable |= stm32gpio_portmask(g_gpiointinputs, BOARD_NGPIOINT,
+                                 batch->port);
+#endif
+
+  if (((batch->set | batch->clear) & ~outputs) != 0)
+    {
+      return -EPERM;
+    }
+
+  base = g_gpiobase[batch->port];
+
+  if ((batch->set | batch->clear) != 0)
+    {
+      /* BSRR sets take priority over resets, as for any pin in both */
+
+      putreg32(((uint32_t)batch->clear << 16) | batch->set,
+               base + STM32_GPIO_BSRR_OFFSET);
+    }
+
+  batch->value = getreg32(base + STM32_GPIO_IDR_OFFSET) & readable;
+  return OK;
+}
 #endif /* CONFIG_DEV_GPIO */
@@ -29,6 +29,8 @@
 #include <errno.h>
 
 #include <nuttx/board.h>
+#include <sys/boardctl.h>
+#include <arch/board/board.h>
 
 #include "josh.h"
 
@@ -64,6 +66,86 @@ int board_ioctl(unsigned int cmd, uintptr_t arg)
 {
   switch (cmd)
     {
+#ifdef CONFIG_JOSH_PPS
+      case BIOC_PPS_STATUS:
+        return stm32_pps_status((FAR struct josh_pps_status_s *)arg);
+#endif
+
+#ifdef CONFIG_JOSH_CALIB
+      case BIOC_CALIB_GET:
+        return stm32_calib_get((FAR struct josh_calib_s *)arg);
+
+      case BIOC_CALIB_SET:
+        return stm32_calib_set((FAR const struct josh_calib_s *)arg);
+#endif
+
+#ifdef CONFIG_JOSH_EECONFIG
+      case BIOC_CONFIG_READ:
+        {
+          FAR struct josh_config_io_s *io =
+            (FAR struct josh_config_io_s *)arg;
+
+          return stm32_eeconfig_read(io->offset, io->buf, io->len);
+        }
+
+      case BIOC_CONFIG_WRITE:
+        {
+          FAR struct josh_config_io_s *io =
+            (FAR struct josh_config_io_s *)arg;
+
+          /* The board's own bytes, such as the uplink replay counter */
+
+          if (io->offset < JOSH_CONFIG_BOARD_SIZE)
+            {
+              return -EACCES;
+            }
+
+          return stm32_eeconfig_write(io->offset, io->buf, io->len);
+        }
+#endif
+
+#ifdef CONFIG_JOSH_RADIO
+      case BIOC_RADIO_STATS:
+        return stm32_radio_stats((FAR struct josh_radio_stats_s *)arg);
+#endif
+
+#ifdef CONFIG_JOSH_USBPM
+      case BIOC_USBPM_STATS:
+        return stm32_usbpm_stats((FAR struct josh_usbpm_stats_s *)arg);
+
+      case BIOC_USBPM_RESUME:
+        return stm32_usbpm_resume();
+#endif
+
+#ifdef CONFIG_JOSH_LEDSEQ
+      case BIOC_LED_CODE:
+        return stm32_ledseq_set((FAR const struct josh_led_code_s *)arg);
+#endif
+
+#ifdef CONFIG_JOSH_TONE
+      case BIOC_TONE_PLAY:
+        return stm32_tone_play((FAR const struct josh_tone_seq_s *)arg);
+
+      case BIOC_TONE_STOP:
+        return stm32_tone_stop();
+#endif
+
+#ifdef CONFIG_DEV_GPIO
+      case BIOC_GPIO_BATCH:
+        return stm32_gpio_batch((FAR struct josh_gpio_batch_s *)arg);
+#endif
+
+#ifdef CONFIG_JOSH_ADC_AWD
+      case BIOC_AWD_STATE:
+        return stm32_adc_awd_state((uint32_t)arg);
+
+      case BIOC_AWD_SNAPSHOT:
+        return stm32_adc_awd_snapshot((FAR struct josh_awd_snapshot_s *)arg);
+
+      case BIOC_AWD_CLEAR:
+        return stm32_adc_awd_clear();
+#endif
+
       default:
         return -ENOTTY;
     }
@@ -0,0 +1,448 @@
+/****************************************************************************
+ * boards/arm/stm32h7/josh/src/stm32_ledseq.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/* Blink code sequencer for the three board LEDs.
+ *
+ * Each LED plays its own code: 'count' blinks of on_ms on and off_ms off,
+ * then pause_ms dark, repeated. The sequencer timer is programmed for the
+ * next transition of any LED, so the only CPU time spent is one short
+ * interrupt per transition. Solid and dark LEDs stop the timer entirely.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/irq.h>
+#include <arch/board/board.h>
+
+#include "arm_internal.h"
+#include "chip.h"
+#include "stm32_gpio.h"
+#include "stm32_tim.h"
+#include "hardware/stm32_tim.h"
+#include "josh.h"
+
+#ifdef CONFIG_JOSH_LEDSEQ
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* 10kHz keeps a whole step in the 16-bit auto-reload register */
+
+#define LEDSEQ_CLOCK      10000
+#define LEDSEQ_TICKS_MS   (LEDSEQ_CLOCK / 1000)
+#define LEDSEQ_MAX_MS     (UINT16_MAX / LEDSEQ_TICKS_MS)
+
+#define LEDSEQ_CNT        (STM32_TIM7_BASE + STM32_BTIM_CNT_OFFSET)
+#define LEDSEQ_EGR        (STM32_TIM7_BASE + STM32_BTIM_EGR_OFFSET)
+#define LEDSEQ_SR         (STM32_TIM7_BASE + STM32_BTIM_SR_OFFSET)
+
+/* Timing used for fields left at zero */
+
+#define LEDSEQ_ON_MS      200
+#define LEDSEQ_OFF_MS     300
+#define LEDSEQ_PAUSE_MS   1500
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+enum ledseq_phase_e
+{
+  LEDSEQ_IDLE = 0,   /* Dark or solid, not on the timer */
+  LEDSEQ_ON,         /* Lit for on_ms */
+  LEDSEQ_OFF,        /* Dark for off_ms between blinks */
+  LEDSEQ_PAUSE       /* Dark for pause_ms after the last blink */
+};
+
+struct ledseq_chan_s
+{
+  uint32_t gpio;                 /* LED pin */
+  struct josh_led_code_s code;   /* Code being played */
+  enum ledseq_phase_e phase;
+  uint8_t blink;                 /* Blinks left in this repetition */
+  uint16_t remain;               /* ms left in this phase */
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static FAR struct stm32_tim_dev_s *g_ledseq_tim;
+static uint16_t g_ledseq_step;   /* ms programmed for the current step */
+static bool g_ledseq_running;
+
+static struct ledseq_chan_s g_ledseq[JOSH_NLEDS] =
+{
+  [JOSH_LED_STATUS] =
+  {
+    .gpio = GPIO_LED_STARTED
+  },
+  [JOSH_LED_ERROR] =
+  {
+    .gpio = GPIO_LED_PANIC
+  },
+  [JOSH_LED_ARMED] =
+  {
+    .gpio = GPIO_LED_EJECT
+  },
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: ledseq_enter
+ *
+ * Description:
+ *   Start a phase of a channel's code and set the LED to match.
+ *
+ ****************************************************************************/
+
+static void ledseq_enter(FAR struct ledseq_chan_s *chan,
+                         enum ledseq_phase_e phase)
+{
+  chan->phase = phase;
+
+  switch (phase)
+    {
+      case LEDSEQ_ON:
+        chan->remain = chan->code.on_ms;
+        break;
+
+      case LEDSEQ_OFF:
+        chan->remain = chan->code.off_ms;
+        break;
+
+      case LEDSEQ_PAUSE:
+        chan->remain = chan->code.pause_ms;
+        break;
+
+      default:
+        chan->remain = 0;
+        break;
+    }
+
+  stm32_gpiowrite(chan->gpio, phase == LEDSEQ_ON);
+}
+
+/****************************************************************************
+ * Name: ledseq_advance
+ ****************************************************************************/
+
+static void ledseq_advance(FAR struct ledseq_chan_s *chan)
+{
+  if (chan->phase == LEDSEQ_ON && --chan->blink > 0)
+    {
+      ledseq_enter(chan, LEDSEQ_OFF);
+    }
+  else if (chan->phase == LEDSEQ_ON)
+    {
+      ledseq_enter(chan, LEDSEQ_PAUSE);
+    }
+  else
+    {
+      /* After the gap between blinks or the pause that ends the code */
+
+      if (chan->phase == LEDSEQ_PAUSE)
+        {
+          chan->blink = chan->code.count;
+        }
+
+      ledseq_enter(chan, LEDSEQ_ON);
+    }
+}
+
+/****************************************************************************
+ * Name: ledseq_elapse
+ *
+ * Description:
+ *   Account for 'ms' passing on every blinking channel and move those whose
+ *   phase has ended on to the next one.
+ *
+ ****************************************************************************/
+
+static void ledseq_elapse(uint16_t ms)
+{
+  FAR struct ledseq_chan_s *chan;
+  int i;
+
+  for (i = 0; i < JOSH_NLEDS; i++)
+    {
+      chan = &g_ledseq[i];
+      if (chan->phase == LEDSEQ_IDLE)
+        {
+          continue;
+        }
+
+      if (chan->remain > ms)
+        {
+          chan->remain -= ms;
+        }
+      else
+        {
+          ledseq_advance(chan);
+        }
+    }
+}
+
+/****************************************************************************
+ * Name: ledseq_schedule
+ *
+ * Description:
+ *   Program the timer for the earliest transition, or stop it if no LED is
+ *   blinking. Called with interrupts disabled.
+ *
+ ****************************************************************************/
+
+static void ledseq_schedule(void)
+{
+  uint16_t next = UINT16_MAX;
+  int i;
+
+  for (i = 0; i < JOSH_NLEDS; i++)
+    {
+      if (g_ledseq[i].phase != LEDSEQ_IDLE && g_ledseq[i].remain < next)
+        {
+          next = g_ledseq[i].remain;
+        }
+    }
+
+  if (next == UINT16_MAX)
+    {
+      STM32_TIM_DISABLEINT(g_ledseq_tim, GTIM_DIER_UIE);
+      STM32_TIM_SETMODE(g_ledseq_tim, STM32_TIM_MODE_DISABLED);
+      g_ledseq_running = false;
+      return;
+    }
+
+  /* The period is preloaded, so force an update to load it and restart
+   * the count now. That sets UIF, and stm32_ledseq_set() may have found
+   * an update pending and charged it already; clear it so the interrupt
+   * does not charge the step again.
+   */
+
+  g_ledseq_step = next;
+  STM32_TIM_SETPERIOD(g_ledseq_tim, next * LEDSEQ_TICKS_MS - 1);
+  putreg32(BTIM_EGR_UG, LEDSEQ_EGR);
+  STM32_TIM_ACKINT(g_ledseq_tim, GTIM_SR_UIF);
+
+  if (!g_ledseq_running)
+    {
+      STM32_TIM_SETMODE(g_ledseq_tim, STM32_TIM_MODE_UP);
+      STM32_TIM_ENABLEINT(g_ledseq_tim, GTIM_DIER_UIE);
+      g_ledseq_running = true;
+    }
+}
+
+/****************************************************************************
+ * Name: ledseq_interrupt
+ *
+ * Description:
+ *   Sequencer timer update interrupt, one per LED transition.
+ *
+ ****************************************************************************/
+
+static int ledseq_interrupt(int irq, FAR void *context, FAR void *arg)
+{
+  /* ledseq_schedule() may have cleared UIF after the interrupt was already
+   * pending in the NVIC.
+   */
+
+  if ((getreg32(LEDSEQ_SR) & BTIM_SR_UIF) == 0)
+    {
+      return OK;
+    }
+
+  STM32_TIM_ACKINT(g_ledseq_tim, GTIM_SR_UIF);
+
+  ledseq_elapse(g_ledseq_step);
+  ledseq_schedule();
+  return OK;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: stm32_ledseq_initialize
+ *
+ * Description:
+ *   Claim the sequencer timer and turn all three LEDs off.
+ *
+ ****************************************************************************/
+
+int stm32_ledseq_initialize(void)
+{
+  int ret;
+  int i;
+
+  if (g_ledseq_tim != NULL)
+    {
+      return OK;
+    }
+
+  g_ledseq_tim = stm32_tim_init(JOSH_LEDSEQ_TIMER);
+  if (g_ledseq_tim == NULL)
+    {
+      lederr("ERROR: Failed to get TIM%d\n", JOSH_LEDSEQ_TIMER);
+      return -ENODEV;
+    }
+
+  ret = STM32_TIM_SETCLOCK(g_ledseq_tim, LEDSEQ_CLOCK);
+  if (ret < 0)
+    {
+      goto errout;
+    }
+
+  ret = STM32_TIM_SETISR(g_ledseq_tim, ledseq_interrupt, NULL, 0);
+  if (ret < 0)
+    {
+      goto errout;
+    }
+
+  STM32_TIM_SETMODE(g_ledseq_tim, STM32_TIM_MODE_DISABLED);
+
+  for (i = 0; i < JOSH_NLEDS; i++)
+    {
+      stm32_configgpio(g_ledseq[i].gpio);
+    }
+
+  return OK;
+
+errout:
+  lederr("ERROR: Failed to set up TIM%d: %d\n", JOSH_LEDSEQ_TIMER, ret);
+  stm32_tim_deinit(g_ledseq_tim);
+  g_ledseq_tim = NULL;
+  return ret;
+}
+
+/****************************************************************************
+ * Name: stm32_ledseq_set
+ *
+ * Description:
+ *   Start playing a blink code on one LED. The LED restarts its code from
+ *   the first blink; the others carry on undisturbed.
+ *
+ *   A count of zero turns the LED off and leaves the pin alone afterwards,
+ *   so the SD eject line on /dev/gpio can use JOSH_LED_ARMED again.
+ *   JOSH_LED_SOLID turns it on steadily.
+ *
+ ****************************************************************************/
+
+int stm32_ledseq_set(FAR const struct josh_led_code_s *code)
+{
+  FAR struct ledseq_chan_s *chan;
+  irqstate_t flags;
+  uint16_t elapsed;
+
+  if (code == NULL || code->led >= JOSH_NLEDS)
+    {
+      return -EINVAL;
+    }
+
+  if (code->on_ms > LEDSEQ_MAX_MS || code->off_ms > LEDSEQ_MAX_MS ||
+      code->pause_ms > LEDSEQ_MAX_MS)
+    {
+      return -ERANGE;
+    }
+
+  if (g_ledseq_tim == NULL)
+    {
+      return -ENODEV;
+    }
+
+  chan = &g_ledseq[code->led];
+
+  flags = enter_critical_section();
+
+  /* Charge the part of the current step that has already passed to the
+   * other LEDs before the timer is reprogrammed, including a whole step
+   * whose update interrupt is still pending.
+   */
+
+  if (g_ledseq_running)
+    {
+      elapsed = getreg32(LEDSEQ_CNT) / LEDSEQ_TICKS_MS;
+      if ((getreg32(LEDSEQ_SR) & BTIM_SR_UIF) != 0)
+        {
+          elapsed += g_ledseq_step;
+        }
+
+      chan->phase = LEDSEQ_IDLE;
+      if (elapsed > 0)
+        {
+          ledseq_elapse(elapsed);
+        }
+    }
+
+  chan->code          = *code;
+  chan->code.on_ms    = code->on_ms ? code->on_ms : LEDSEQ_ON_MS;
+  chan->code.off_ms   = code->off_ms ? code->off_ms : LEDSEQ_OFF_MS;
+  chan->code.pause_ms = code->pause_ms ? code->pause_ms : LEDSEQ_PAUSE_MS;
+
+  if (code->count == 0 || code->count == JOSH_LED_SOLID)
+    {
+      chan->phase = LEDSEQ_IDLE;
+      stm32_gpiowrite(chan->gpio, code->count == JOSH_LED_SOLID);
+    }
+  else
+    {
+      chan->blink = code->count;
+      ledseq_enter(chan, LEDSEQ_ON);
+    }
+
+  ledseq_schedule();
+  leave_critical_section(flags);
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: stm32_ledseq_halt
+ *
+ * Description:
+ *   Stop the sequencer where it is, leaving the LEDs to the panic code.
+ *   Safe to call from an assertion with interrupts disabled.
+ *
+ ****************************************************************************/
+
+void stm32_ledseq_halt(void)
+{
+  if (g_ledseq_tim != NULL)
+    {
+      STM32_TIM_DISABLEINT(g_ledseq_tim, GTIM_DIER_UIE);
+      STM32_TIM_SETMODE(g_ledseq_tim, STM32_TIM_MODE_DISABLED);
+      g_ledseq_running = false;
+    }
+}
+
+#endif /* CONFIG_JOSH_LEDSEQ */
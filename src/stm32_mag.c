@@ -0,0 +1,251 @@
+/****************************************************************************
+ * boards/arm/stm32h7/josh/src/stm32_mag.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/irq.h>
+#include <nuttx/i2c/i2c_master.h>
+#include <arch/board/board.h>
+
+#include "stm32_gpio.h"
+#include "stm32_i2c.h"
+#include "josh.h"
+
+#ifdef CONFIG_SENSORS_LIS2MDL
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define MAG_I2C_BUS         1
+#define MAG_I2C_ADDR        0x1e
+#define MAG_I2C_FREQUENCY   400000
+
+/* LIS2MDL configuration registers */
+
+#define LIS2MDL_CFG_REG_B   0x61
+#define LIS2MDL_CFG_REG_C   0x62
+
+#define CFG_REG_B_LPF       (1 << 0) /* Digital low-pass filter, ODR/4 */
+#define CFG_REG_B_OFF_CANC  (1 << 1) /* Continuous offset cancellation */
+#define CFG_REG_C_BDU       (1 << 4) /* Block data update */
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_MAG_COALESCE
+static xcpt_t g_mag_handler;     /* LIS2MDL driver's data-ready handler */
+static FAR void *g_mag_arg;
+static xcpt_t g_imu_handler;     /* LSM6DSO32 accelerometer handler */
+static FAR void *g_imu_arg;
+static uint16_t g_imu_count;     /* IMU interrupts since last mag read */
+#endif
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: mag_modifyreg
+ *
+ * Description:
+ *   Read-modify-write a LIS2MDL register.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_MAG_CONFIGURE
+static int mag_modifyreg(FAR struct i2c_master_s *i2c, uint8_t reg,
+                         uint8_t clearbits, uint8_t setbits)
+{
+  struct i2c_msg_s msg[2];
+  uint8_t buf[2];
+  int ret;
+
+  msg[0].frequency = MAG_I2C_FREQUENCY;
+  msg[0].addr      = MAG_I2C_ADDR;
+  msg[0].flags     = 0;
+  msg[0].buffer    = &reg;
+  msg[0].length    = 1;
+
+  msg[1].frequency = MAG_I2C_FREQUENCY;
+  msg[1].addr      = MAG_I2C_ADDR;
+  msg[1].flags     = I2C_M_READ;
+  msg[1].buffer    = &buf[1];
+  msg[1].length    = 1;
+
+  ret = I2C_TRANSFER(i2c, msg, 2);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  buf[0] = reg;
+  buf[1] = (buf[1] & ~clearbits) | setbits;
+
+  msg[0].buffer = buf;
+  msg[0].length = 2;
+
+  return I2C_TRANSFER(i2c, msg, 1);
+}
+#endif
+
+#ifdef CONFIG_JOSH_MAG_COALESCE
+/****************************************************************************
+ * Name: mag_imu_interrupt
+ *
+ * Description:
+ *   LSM6DSO32 accelerometer data-ready interrupt. The IMU read is queued
+ *   first and, every CONFIG_JOSH_MAG_COALESCE_DIVIDER interrupts, the
+ *   magnetometer read is queued right behind it so both transactions run
+ *   back to back in the same I2C1 window.
+ *
+ ****************************************************************************/
+
+static int mag_imu_interrupt(int irq, FAR void *context, FAR void *arg)
+{
+  int ret = OK;
+
+  if (g_imu_handler != NULL)
+    {
+      ret = g_imu_handler(irq, context, g_imu_arg);
+    }
+
+  if (g_mag_handler != NULL &&
+      ++g_imu_count >= CONFIG_JOSH_MAG_COALESCE_DIVIDER)
+    {
+      g_imu_count = 0;
+      g_mag_handler(irq, context, g_mag_arg);
+    }
+
+  return ret;
+}
+#endif
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: stm32_mag_configure
+ *
+ * Description:
+ *   Apply the board's LIS2MDL filtering options after the driver has been
+ *   registered: continuous offset cancellation, the digital low-pass
+ *   filter and block data update.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_MAG_CONFIGURE
+int stm32_mag_configure(void)
+{
+  FAR struct i2c_master_s *i2c;
+  uint8_t setbits = 0;
+  int ret;
+
+  i2c = stm32_i2cbus_initialize(MAG_I2C_BUS);
+  if (i2c == NULL)
+    {
+      return -ENODEV;
+    }
+
+#ifdef CONFIG_JOSH_MAG_OFFSET_CANCEL
+  setbits |= CFG_REG_B_OFF_CANC;
+#endif
+#ifdef CONFIG_JOSH_MAG_LPF
+  setbits |= CFG_REG_B_LPF;
+#endif
+
+  ret = mag_modifyreg(i2c, LIS2MDL_CFG_REG_B,
+                      CFG_REG_B_OFF_CANC | CFG_REG_B_LPF, setbits);
+  if (ret < 0)
+    {
+      snerr("ERROR: Failed to configure LIS2MDL filters: %d\n", ret);
+      return ret;
+    }
+
+  /* Never read a half-updated sample when reads are not aligned to the
+   * data-ready edge.
+   */
+
+  return mag_modifyreg(i2c, LIS2MDL_CFG_REG_C, 0, CFG_REG_C_BDU);
+}
+#endif
+
+#ifdef CONFIG_JOSH_MAG_COALESCE
+/****************************************************************************
+ * Name: stm32_mag_attach
+ *
+ * Description:
+ *   Attach the LIS2MDL data-ready handler. The magnetometer's own EXTI line
+ *   is not used; the handler is dispatched from the IMU interrupt instead.
+ *
+ ****************************************************************************/
+
+int stm32_mag_attach(xcpt_t handler, FAR void *arg)
+{
+  irqstate_t flags;
+
+  flags = enter_critical_section();
+  g_mag_handler = handler;
+  g_mag_arg     = arg;
+  g_imu_count   = 0;
+  leave_critical_section(flags);
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: stm32_mag_imu_attach
+ *
+ * Description:
+ *   Attach the LSM6DSO32 accelerometer data-ready handler on 'pinset',
+ *   with the magnetometer reads coalesced into the same interrupt.
+ *
+ ****************************************************************************/
+
+int stm32_mag_imu_attach(uint32_t pinset, xcpt_t handler, FAR void *arg)
+{
+  int ret;
+
+  ret = stm32_configgpio(pinset);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  g_imu_handler = handler;
+  g_imu_arg     = arg;
+
+  return stm32_gpiosetevent(pinset, true, false, false, mag_imu_interrupt,
+                            NULL);
+}
+#endif /* CONFIG_JOSH_MAG_COALESCE */
+
+#endif /* CONFIG_SENSORS_LIS2MDL */
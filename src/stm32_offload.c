@@ -0,0 +1,855 @@
+/****************************************************************************
+ * boards/arm/stm32h7/josh/src/stm32_offload.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/* Bulk file offload over USB CDC-ACM.
+ *
+ * A kernel thread owns CONFIG_JOSH_OFFLOAD_DEVPATH and speaks a binary
+ * protocol with tools/josh_offload.py. Every frame is:
+ *
+ *   'J' 'O' | type (1) | 0 (1) | length (2, LE) | payload | CRC32 (4, LE)
+ *
+ * The CRC is NuttX crc32() (reflected 0xedb88320, no inversion) over the
+ * type, reserved and length bytes and the payload. Frames with a bad CRC are
+ * dropped and the receiver resynchronises on the next 'J' 'O'.
+ *
+ * A GET names a file under /mnt/usrfs or /mnt/pwrfs and the offset to start
+ * from, so an interrupted transfer resumes where the host left off. The
+ * board streams DATA chunks with up to CONFIG_JOSH_OFFLOAD_WINDOW of them
+ * unacknowledged. The host ACKs the next offset it wants; on a gap it
+ * sends a NAK and the board goes back to that offset. Without an ACK for
+ * CONFIG_JOSH_OFFLOAD_TIMEOUT_MS the board goes back to the last ACK.
+ *
+ * With CONFIG_JOSH_OFFLOAD_STREAM, a STREAM request subscribes to a set of
+ * sensor topics. Every sample published on them is forwarded unmodified in
+ * TELEM frames, unacknowledged, alongside any file transfer.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include <nuttx/clock.h>
+#include <nuttx/crc32.h>
+#include <nuttx/kthread.h>
+#include <nuttx/semaphore.h>
+#include <nuttx/fs/fs.h>
+
+#ifdef CONFIG_JOSH_OFFLOAD_STREAM
+#  include <nuttx/uorb.h>
+#endif
+
+#include "josh.h"
+
+#ifdef CONFIG_JOSH_OFFLOAD
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define OFFLOAD_DEVPATH    CONFIG_JOSH_OFFLOAD_DEVPATH
+#define OFFLOAD_CHUNK      CONFIG_JOSH_OFFLOAD_CHUNK
+#define OFFLOAD_WINDOW     (CONFIG_JOSH_OFFLOAD_WINDOW * OFFLOAD_CHUNK)
+#define OFFLOAD_TIMEOUT    MSEC2TICK(CONFIG_JOSH_OFFLOAD_TIMEOUT_MS)
+#define OFFLOAD_RETRIES    8
+
+#define OFFLOAD_SYNC0      'J'
+#define OFFLOAD_SYNC1      'O'
+#define OFFLOAD_HDRLEN     6
+#define OFFLOAD_CRCLEN     4
+#define OFFLOAD_PATHMAX    128
+#define OFFLOAD_NTOPICS    7
+
+/* Largest frames in each direction */
+
+#define OFFLOAD_RXMAX      (OFFLOAD_HDRLEN + 4 + OFFLOAD_PATHMAX + \
+                            OFFLOAD_CRCLEN)
+#define OFFLOAD_TXMAX      (OFFLOAD_HDRLEN + 4 + OFFLOAD_CHUNK + \
+                            OFFLOAD_CRCLEN)
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+enum offload_type_e
+{
+  /* Host to board */
+
+  OFFLOAD_LIST  = 0x01,   /* path: list a directory */
+  OFFLOAD_GET   = 0x02,   /* offset (4) | path: start a transfer */
+  OFFLOAD_ACK   = 0x03,   /* offset (4): all bytes before it received */
+  OFFLOAD_NAK   = 0x04,   /* offset (4): resend from here */
+  OFFLOAD_ABORT = 0x05,   /* Stop the transfer */
+  OFFLOAD_STREAM = 0x06,  /* mask (1): topics to stream, 0 to stop */
+
+  /* Board to host */
+
+  OFFLOAD_OK    = 0x80,   /* size (4): file size, or entry count */
+  OFFLOAD_ENTRY = 0x81,   /* size (4) | name: one directory entry */
+  OFFLOAD_DATA  = 0x82,   /* offset (4) | bytes */
+  OFFLOAD_END   = 0x83,   /* size (4): transfer complete */
+  OFFLOAD_TELEM = 0x84,   /* topic (1) | samples */
+  OFFLOAD_ERROR = 0xff,   /* errno (4) */
+};
+
+#ifdef CONFIG_JOSH_OFFLOAD_STREAM
+struct offload_topic_s
+{
+  FAR const char *path;
+  uint16_t esize;                         /* Sample size */
+};
+#endif
+
+struct offload_s
+{
+  struct file rxdev;                      /* Non-blocking reads */
+  struct file txdev;                      /* Blocking writes */
+  struct file file;                       /* File being sent */
+  bool active;                            /* file is open */
+  uint32_t size;                          /* File size */
+  uint32_t acked;                         /* Host has bytes before this */
+  uint32_t sent;                          /* Next byte to send */
+  clock_t ack_time;                       /* Last ACK or rewind */
+  int retries;                            /* Timeouts without progress */
+#ifdef CONFIG_JOSH_OFFLOAD_STREAM
+  struct file topic[OFFLOAD_NTOPICS];     /* Streamed topics */
+  uint8_t streaming;                      /* Mask of open topics */
+#endif
+  sem_t pollsem;                          /* Posted when any poll fires */
+  struct pollfd fds[1 + OFFLOAD_NTOPICS]; /* rxdev and streamed topics */
+  size_t rxlen;                           /* Bytes in rx */
+  uint8_t rx[OFFLOAD_RXMAX];
+  uint8_t tx[OFFLOAD_TXMAX];
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_OFFLOAD_STREAM
+/* Topics that can be streamed; the STREAM mask and TELEM topic byte index
+ * this table.
+ */
+
+static const struct offload_topic_s g_offload_topics[OFFLOAD_NTOPICS] =
+{
+  { "/dev/uorb/sensor_accel0",   sizeof(struct sensor_accel) },
+  { "/dev/uorb/sensor_gyro0",    sizeof(struct sensor_gyro) },
+  { "/dev/uorb/sensor_mag0",     sizeof(struct sensor_mag) },
+  { "/dev/uorb/sensor_baro0",    sizeof(struct sensor_baro) },
+  { "/dev/uorb/sensor_gnss0",    sizeof(struct sensor_gnss) },
+  { "/dev/uorb/sensor_volt0",    sizeof(struct sensor_volt) },
+  { "/dev/uorb/sensor_current0", sizeof(struct sensor_current) },
+};
+#endif
+
+static struct offload_s g_offload =
+{
+  .pollsem = SEM_INITIALIZER(0),
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static inline uint32_t offload_get32(FAR const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void offload_put32(FAR uint8_t *p, uint32_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+/****************************************************************************
+ * Name: offload_send
+ *
+ * Description:
+ *   Frame and send the 'len' payload bytes already at tx[OFFLOAD_HDRLEN].
+ *
+ ****************************************************************************/
+
+static int offload_send(FAR struct offload_s *off, uint8_t type, size_t len)
+{
+  FAR uint8_t *tx = off->tx;
+  size_t total = OFFLOAD_HDRLEN + len + OFFLOAD_CRCLEN;
+  size_t done = 0;
+  ssize_t nwritten;
+
+  tx[0] = OFFLOAD_SYNC0;
+  tx[1] = OFFLOAD_SYNC1;
+  tx[2] = type;
+  tx[3] = 0;
+  tx[4] = len;
+  tx[5] = len >> 8;
+  offload_put32(&tx[OFFLOAD_HDRLEN + len],
+                crc32(&tx[2], OFFLOAD_HDRLEN - 2 + len));
+
+  while (done < total)
+    {
+      nwritten = file_write(&off->txdev, &tx[done], total - done);
+      if (nwritten < 0)
+        {
+          return nwritten;
+        }
+
+      done += nwritten;
+    }
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: offload_send32
+ ****************************************************************************/
+
+static int offload_send32(FAR struct offload_s *off, uint8_t type,
+                          uint32_t value)
+{
+  offload_put32(&off->tx[OFFLOAD_HDRLEN], value);
+  return offload_send(off, type, 4);
+}
+
+/****************************************************************************
+ * Name: offload_path
+ *
+ * Description:
+ *   Copy a path from a request, refusing anything outside the SD card
+ *   partitions.
+ *
+ ****************************************************************************/
+
+static int offload_path(FAR char *path, FAR const uint8_t *src, size_t len)
+{
+  if (len == 0 || len >= OFFLOAD_PATHMAX)
+    {
+      return -EINVAL;
+    }
+
+  memcpy(path, src, len);
+  path[len] = '\0';
+
+  if (strlen(path) != len || strstr(path, "..") != NULL)
+    {
+      return -EINVAL;
+    }
+
+  if (strncmp(path, "/mnt/usrfs", 10) != 0 &&
+      strncmp(path, "/mnt/pwrfs", 10) != 0)
+    {
+      return -EACCES;
+    }
+
+  return path[10] == '\0' || path[10] == '/' ? OK : -EACCES;
+}
+
+/****************************************************************************
+ * Name: offload_close
+ ****************************************************************************/
+
+static void offload_close(FAR struct offload_s *off)
+{
+  if (off->active)
+    {
+      file_close(&off->file);
+      off->active = false;
+    }
+}
+
+/****************************************************************************
+ * Name: offload_list
+ ****************************************************************************/
+
+static int offload_list(FAR struct offload_s *off, FAR const uint8_t *req,
+                        size_t len)
+{
+  char path[OFFLOAD_PATHMAX + NAME_MAX + 2];
+  FAR struct dirent *entry;
+  FAR DIR *dir;
+  struct stat st;
+  uint32_t count = 0;
+  size_t namelen;
+  int ret;
+
+  ret = offload_path(path, req, len);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  dir = opendir(path);
+  if (dir == NULL)
+    {
+      return -errno;
+    }
+
+  while ((entry = readdir(dir)) != NULL)
+    {
+      namelen = strlen(entry->d_name);
+      snprintf(&path[len], sizeof(path) - len, "/%s", entry->d_name);
+
+      if (stat(path, &st) < 0)
+        {
+          st.st_size = 0;
+        }
+
+      /* Directories are reported with the size 0xffffffff */
+
+      offload_put32(&off->tx[OFFLOAD_HDRLEN],
+                    S_ISDIR(st.st_mode) ? UINT32_MAX : st.st_size);
+      memcpy(&off->tx[OFFLOAD_HDRLEN + 4], entry->d_name, namelen);
+
+      ret = offload_send(off, OFFLOAD_ENTRY, 4 + namelen);
+      if (ret < 0)
+        {
+          break;
+        }
+
+      count++;
+    }
+
+  closedir(dir);
+  return ret < 0 ? ret : offload_send32(off, OFFLOAD_OK, count);
+}
+
+/****************************************************************************
+ * Name: offload_get
+ ****************************************************************************/
+
+static int offload_get(FAR struct offload_s *off, FAR const uint8_t *req,
+                       size_t len)
+{
+  char path[OFFLOAD_PATHMAX];
+  struct stat st;
+  uint32_t offset;
+  int ret;
+
+  offload_close(off);
+
+  if (len < 4)
+    {
+      return -EINVAL;
+    }
+
+  offset = offload_get32(req);
+  ret = offload_path(path, &req[4], len - 4);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  ret = file_open(&off->file, path, O_RDONLY);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  ret = file_fstat(&off->file, &st);
+  if (ret >= 0 && offset > st.st_size)
+    {
+      ret = -EINVAL;
+    }
+
+  if (ret >= 0)
+    {
+      ret = file_seek(&off->file, offset, SEEK_SET);
+    }
+
+  if (ret < 0)
+    {
+      file_close(&off->file);
+      return ret;
+    }
+
+  off->active   = true;
+  off->size     = st.st_size;
+  off->acked    = offset;
+  off->sent     = offset;
+  off->ack_time = clock_systime_ticks();
+  off->retries  = 0;
+
+  finfo("Offloading %s from %" PRIu32 "\n", path, offset);
+  return offload_send32(off, OFFLOAD_OK, off->size);
+}
+
+/****************************************************************************
+ * Name: offload_rewind
+ *
+ * Description:
+ *   Go back to 'offset' and resend from there.
+ *
+ ****************************************************************************/
+
+static int offload_rewind(FAR struct offload_s *off, uint32_t offset)
+{
+  off->acked    = offset;
+  off->sent     = offset;
+  off->ack_time = clock_systime_ticks();
+  return file_seek(&off->file, offset, SEEK_SET);
+}
+
+#ifdef CONFIG_JOSH_OFFLOAD_STREAM
+/****************************************************************************
+ * Name: offload_subscribe
+ *
+ * Description:
+ *   Open the topics in 'mask' and close the others. Topics that do not
+ *   exist on this build are skipped.
+ *
+ ****************************************************************************/
+
+static void offload_subscribe(FAR struct offload_s *off, uint8_t mask)
+{
+  int i;
+
+  for (i = 0; i < OFFLOAD_NTOPICS; i++)
+    {
+      bool want = (mask & (1 << i)) != 0;
+      bool open = (off->streaming & (1 << i)) != 0;
+
+      if (open && !want)
+        {
+          file_close(&off->topic[i]);
+          off->streaming &= ~(1 << i);
+        }
+      else if (want && !open &&
+               file_open(&off->topic[i], g_offload_topics[i].path,
+                         O_RDONLY | O_NONBLOCK) >= 0)
+        {
+          off->streaming |= 1 << i;
+        }
+    }
+}
+
+/****************************************************************************
+ * Name: offload_stream
+ *
+ * Description:
+ *   Forward whatever samples have been published since the last call.
+ *
+ * Returned Value:
+ *   True if anything was sent.
+ *
+ ****************************************************************************/
+
+static bool offload_stream(FAR struct offload_s *off)
+{
+  bool sent = false;
+  ssize_t nread;
+  size_t len;
+  int i;
+
+  for (i = 0; i < OFFLOAD_NTOPICS; i++)
+    {
+      if ((off->streaming & (1 << i)) == 0)
+        {
+          continue;
+        }
+
+      /* Whole samples only, as many as fit in a chunk */
+
+      len   = OFFLOAD_CHUNK / g_offload_topics[i].esize *
+              g_offload_topics[i].esize;
+      nread = file_read(&off->topic[i], &off->tx[OFFLOAD_HDRLEN + 1], len);
+      if (nread > 0)
+        {
+          off->tx[OFFLOAD_HDRLEN] = i;
+          sent |= offload_send(off, OFFLOAD_TELEM, 1 + nread) >= 0;
+        }
+    }
+
+  return sent;
+}
+#endif
+
+/****************************************************************************
+ * Name: offload_handle
+ *
+ * Description:
+ *   Act on one request from the host.
+ *
+ ****************************************************************************/
+
+static void offload_handle(FAR struct offload_s *off, uint8_t type,
+                           FAR const uint8_t *payload, size_t len)
+{
+  uint32_t offset = len >= 4 ? offload_get32(payload) : 0;
+  int ret = OK;
+
+  switch (type)
+    {
+      case OFFLOAD_LIST:
+        ret = offload_list(off, payload, len);
+        break;
+
+      case OFFLOAD_GET:
+        ret = offload_get(off, payload, len);
+        break;
+
+      case OFFLOAD_ACK:
+        if (off->active && offset > off->acked && offset <= off->sent)
+          {
+            off->acked    = offset;
+            off->ack_time = clock_systime_ticks();
+            off->retries  = 0;
+          }
+        break;
+
+      case OFFLOAD_NAK:
+        if (off->active && offset >= off->acked && offset <= off->sent)
+          {
+            ret = offload_rewind(off, offset);
+          }
+        break;
+
+      case OFFLOAD_ABORT:
+        offload_close(off);
+        break;
+
+#ifdef CONFIG_JOSH_OFFLOAD_STREAM
+      case OFFLOAD_STREAM:
+        offload_subscribe(off, len >= 1 ? payload[0] : 0);
+        ret = offload_send32(off, OFFLOAD_OK, off->streaming);
+        break;
+#endif
+
+      default:
+        ret = -ENOSYS;
+        break;
+    }
+
+  if (ret < 0)
+    {
+      offload_send32(off, OFFLOAD_ERROR, -ret);
+    }
+}
+
+/****************************************************************************
+ * Name: offload_receive
+ *
+ * Description:
+ *   Read whatever the host has sent and handle the complete frames in it.
+ *
+ * Returned Value:
+ *   True if anything was received.
+ *
+ ****************************************************************************/
+
+static bool offload_receive(FAR struct offload_s *off)
+{
+  FAR uint8_t *rx = off->rx;
+  ssize_t nread;
+  size_t total;
+  size_t len;
+  size_t skip;
+
+  nread = file_read(&off->rxdev, &rx[off->rxlen],
+                    sizeof(off->rx) - off->rxlen);
+  if (nread <= 0)
+    {
+      return false;
+    }
+
+  off->rxlen += nread;
+
+  for (; ; )
+    {
+      /* Drop anything before the sync bytes */
+
+      for (skip = 0; skip + 1 < off->rxlen; skip++)
+        {
+          if (rx[skip] == OFFLOAD_SYNC0 && rx[skip + 1] == OFFLOAD_SYNC1)
+            {
+              break;
+            }
+        }
+
+      off->rxlen -= skip;
+      memmove(rx, &rx[skip], off->rxlen);
+
+      if (off->rxlen < OFFLOAD_HDRLEN)
+        {
+          break;
+        }
+
+      len   = rx[4] | (rx[5] << 8);
+      total = OFFLOAD_HDRLEN + len + OFFLOAD_CRCLEN;
+      if (total > sizeof(off->rx))
+        {
+          skip = 1;
+        }
+      else if (off->rxlen < total)
+        {
+          break;
+        }
+      else if (crc32(&rx[2], OFFLOAD_HDRLEN - 2 + len) !=
+               offload_get32(&rx[OFFLOAD_HDRLEN + len]))
+        {
+          skip = 1;
+        }
+      else
+        {
+          offload_handle(off, rx[2], &rx[OFFLOAD_HDRLEN], len);
+          skip = total;
+        }
+
+      off->rxlen -= skip;
+      memmove(rx, &rx[skip], off->rxlen);
+    }
+
+  return true;
+}
+
+/****************************************************************************
+ * Name: offload_pump
+ *
+ * Description:
+ *   Send file data while the window allows, and handle the end of the
+ *   transfer and ACK timeouts.
+ *
+ * Returned Value:
+ *   True if anything was sent.
+ *
+ ****************************************************************************/
+
+static bool offload_pump(FAR struct offload_s *off)
+{
+  ssize_t nread;
+  size_t len;
+  int ret;
+
+  if (off->acked == off->size)
+    {
+      offload_send32(off, OFFLOAD_END, off->size);
+      offload_close(off);
+      return true;
+    }
+
+  if (off->sent < off->size && off->sent - off->acked < OFFLOAD_WINDOW)
+    {
+      len   = MIN(OFFLOAD_CHUNK, off->size - off->sent);
+      nread = file_read(&off->file, &off->tx[OFFLOAD_HDRLEN + 4], len);
+      if (nread > 0)
+        {
+          offload_put32(&off->tx[OFFLOAD_HDRLEN], off->sent);
+          ret = offload_send(off, OFFLOAD_DATA, 4 + nread);
+          if (ret >= 0)
+            {
+              off->sent += nread;
+              return true;
+            }
+        }
+      else
+        {
+          ret = nread < 0 ? nread : -EIO;
+        }
+
+      ferr("ERROR: Offload failed at %" PRIu32 ": %d\n", off->sent, ret);
+      offload_send32(off, OFFLOAD_ERROR, -ret);
+      offload_close(off);
+      return false;
+    }
+
+  if (clock_systime_ticks() - off->ack_time >= OFFLOAD_TIMEOUT)
+    {
+      if (++off->retries > OFFLOAD_RETRIES)
+        {
+          offload_send32(off, OFFLOAD_ERROR, ETIMEDOUT);
+          offload_close(off);
+        }
+      else
+        {
+          offload_rewind(off, off->acked);
+        }
+    }
+
+  return false;
+}
+
+/****************************************************************************
+ * Name: offload_pollnotify
+ ****************************************************************************/
+
+static void offload_pollnotify(FAR struct pollfd *fds)
+{
+  nxsem_post((FAR sem_t *)fds->arg);
+}
+
+/****************************************************************************
+ * Name: offload_wait
+ *
+ * Description:
+ *   Sleep until the host sends something, a streamed topic is published,
+ *   or the ACK timeout of a stalled transfer runs out.
+ *
+ ****************************************************************************/
+
+static void offload_wait(FAR struct offload_s *off)
+{
+  FAR struct pollfd *fds = off->fds;
+  FAR struct file *filep[1 + OFFLOAD_NTOPICS];
+  clock_t elapsed;
+  int nfds = 0;
+  int i;
+
+  filep[nfds++] = &off->rxdev;
+
+#ifdef CONFIG_JOSH_OFFLOAD_STREAM
+  for (i = 0; i < OFFLOAD_NTOPICS; i++)
+    {
+      if ((off->streaming & (1 << i)) != 0)
+        {
+          filep[nfds++] = &off->topic[i];
+        }
+    }
+#endif
+
+  for (i = 0; i < nfds; i++)
+    {
+      memset(&fds[i], 0, sizeof(fds[i]));
+      fds[i].events = POLLIN;
+      fds[i].arg    = &off->pollsem;
+      fds[i].cb     = offload_pollnotify;
+      file_poll(filep[i], &fds[i], true);
+    }
+
+  /* A transfer only stalls with the window full or all data sent, waiting
+   * for an ACK; otherwise there is nothing to time out.
+   */
+
+  if (off->active)
+    {
+      elapsed = clock_systime_ticks() - off->ack_time;
+      if (elapsed < OFFLOAD_TIMEOUT)
+        {
+          nxsem_tickwait_uninterruptible(&off->pollsem,
+                                         OFFLOAD_TIMEOUT - elapsed);
+        }
+    }
+  else
+    {
+      nxsem_wait_uninterruptible(&off->pollsem);
+    }
+
+  for (i = 0; i < nfds; i++)
+    {
+      file_poll(filep[i], &fds[i], false);
+    }
+
+  /* Several sources may have fired; they are all serviced next pass */
+
+  while (nxsem_trywait(&off->pollsem) >= 0)
+    {
+    }
+}
+
+/****************************************************************************
+ * Name: offload_thread
+ ****************************************************************************/
+
+static int offload_thread(int argc, FAR char *argv[])
+{
+  FAR struct offload_s *off = &g_offload;
+  bool busy;
+  int ret;
+
+  ret = file_open(&off->rxdev, OFFLOAD_DEVPATH, O_RDONLY | O_NONBLOCK);
+  if (ret >= 0)
+    {
+      ret = file_open(&off->txdev, OFFLOAD_DEVPATH, O_WRONLY);
+      if (ret < 0)
+        {
+          file_close(&off->rxdev);
+        }
+    }
+
+  if (ret < 0)
+    {
+      ferr("ERROR: Failed to open %s: %d\n", OFFLOAD_DEVPATH, ret);
+      return ret;
+    }
+
+  for (; ; )
+    {
+      busy = offload_receive(off);
+      if (off->active)
+        {
+          busy |= offload_pump(off);
+        }
+
+#ifdef CONFIG_JOSH_OFFLOAD_STREAM
+      if (off->streaming != 0)
+        {
+          busy |= offload_stream(off);
+        }
+#endif
+
+      if (!busy)
+        {
+          offload_wait(off);
+        }
+    }
+
+  return OK;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: stm32_offload_initialize
+ *
+ * Description:
+ *   Start the USB file offload service on CONFIG_JOSH_OFFLOAD_DEVPATH. The
+ *   CDC-ACM device must already be registered.
+ *
+ ****************************************************************************/
+
+int stm32_offload_initialize(void)
+{
+  int ret;
+
+  ret = kthread_create("offload", CONFIG_JOSH_OFFLOAD_PRIORITY,
+                       CONFIG_JOSH_OFFLOAD_STACKSIZE, offload_thread, NULL);
+  return ret < 0 ? ret : OK;
+}
+
+#endif /* CONFIG_JOSH_OFFLOAD */
@@ -0,0 +1,385 @@
+/****************************************************************************
+ * boards/arm/stm32h7/josh/src/stm32_pps.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/* GNSS PPS-disciplined timebase.
+ *
+ * TIM5 is a 32-bit timer free-running at its full kernel clock (240MHz,
+ * ~4ns resolution, wrapping every ~17.9s). The L86 PPS rising edge is
+ * captured on TIM5 CH1, so the count of timer cycles between two edges is
+ * the true frequency of the local oscillator as measured against GNSS.
+ * Any later instant is converted to UTC by extrapolating from the last
+ * captured edge with that measured frequency.
+ *
+ * Each edge is labelled with its UTC second from the GNSS fix that follows
+ * it on the uORB sensor_gnss topic.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/irq.h>
+#include <nuttx/clock.h>
+#include <nuttx/wqueue.h>
+#include <nuttx/fs/fs.h>
+#include <nuttx/sensors/sensor.h>
+#include <arch/board/board.h>
+
+#include "arm_internal.h"
+#include "chip.h"
+#include "stm32_gpio.h"
+#include "stm32_tim.h"
+#include "hardware/stm32_tim.h"
+#include "josh.h"
+
+#ifdef CONFIG_JOSH_PPS
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define PPS_TIM_BASE      STM32_TIM5_BASE
+#define PPS_CLOCK         STM32_APB1_TIM5_CLKIN
+
+#define PPS_CCMR1         (PPS_TIM_BASE + STM32_GTIM_CCMR1_OFFSET)
+#define PPS_CCER          (PPS_TIM_BASE + STM32_GTIM_CCER_OFFSET)
+#define PPS_CCR1          (PPS_TIM_BASE + STM32_GTIM_CCR1_OFFSET)
+#define PPS_CNT           (PPS_TIM_BASE + STM32_GTIM_CNT_OFFSET)
+
+#define PPS_GNSS_TOPIC    "/dev/uorb/sensor_gnss0"
+
+/* Edges further than this from the nominal clock are glitches */
+
+#define PPS_MAX_ERROR_PPM 500
+#define PPS_MAX_ERROR     ((uint32_t)((uint64_t)PPS_CLOCK * \
+                                      PPS_MAX_ERROR_PPM / 1000000))
+
+/* The measured frequency is kept in 24.8 fixed point and low-pass filtered
+ * with a time constant of 2^PPS_FILTER_SHIFT seconds.
+ */
+
+#define PPS_FRAC_SHIFT    8
+#define PPS_FILTER_SHIFT  3
+
+/* The RMC sentence for a second arrives well after its PPS edge */
+
+#define PPS_LABEL_DELAY   MSEC2TICK(500)
+
+/* Declare the lock lost if no edge has been seen for this long. This also
+ * keeps the cycle count passed to pps_cycles_to_ns() below 2^29.
+ */
+
+#define PPS_TIMEOUT_NS    (2 * NSEC_PER_SEC)
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct pps_state_s
+{
+  FAR struct stm32_tim_dev_s *tim; /* TIM5 */
+  struct work_s work;              /* Labels edges with UTC */
+  struct file gnss;                /* GNSS topic subscription */
+  bool subscribed;                 /* GNSS topic is open */
+  uint32_t npulses;                /* Edges captured */
+  uint32_t capture;                /* TIM5 count at last edge */
+  uint64_t freq;                   /* Filtered clock, 24.8 fixed point */
+  uint64_t scale;                  /* ns per cycle, 32.32 fixed point */
+  uint64_t mono_ns;                /* Monotonic time at last edge */
+  uint32_t label_pulse;            /* Edge labelled with UTC */
+  uint64_t label_sec;              /* UTC second of that edge */
+  bool labelled;                   /* label_* are valid */
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct pps_state_s g_pps;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: pps_cycles_to_ns
+ ****************************************************************************/
+
+static inline uint64_t pps_cycles_to_ns(uint32_t cycles)
+{
+  return ((uint64_t)cycles * g_pps.scale) >> 32;
+}
+
+/****************************************************************************
+ * Name: pps_update_scale
+ *
+ * Description:
+ *   Recompute the nanoseconds per TIM5 cycle (32.32 fixed point) from the
+ *   filtered frequency. Rounding the frequency to whole Hz costs at most
+ *   ~4ns over a second.
+ *
+ ****************************************************************************/
+
+static inline void pps_update_scale(void)
+{
+  uint64_t hz;
+
+  hz = (g_pps.freq + (1 << (PPS_FRAC_SHIFT - 1))) >> PPS_FRAC_SHIFT;
+
+  g_pps.scale = ((uint64_t)NSEC_PER_SEC << 32) / hz;
+}
+
+/****************************************************************************
+ * Name: pps_label_worker
+ *
+ * Description:
+ *   Label the most recent edge with the UTC second of the GNSS fix that
+ *   followed it.
+ *
+ ****************************************************************************/
+
+static void pps_label_worker(FAR void *arg)
+{
+  struct sensor_gnss gnss;
+  irqstate_t flags;
+  uint32_t pulse;
+  ssize_t nread;
+  int ret;
+
+  if (!g_pps.subscribed)
+    {
+      ret = file_open(&g_pps.gnss, PPS_GNSS_TOPIC, O_RDONLY | O_NONBLOCK);
+      if (ret < 0)
+        {
+          return;
+        }
+
+      g_pps.subscribed = true;
+    }
+
+  nread = file_read(&g_pps.gnss, &gnss, sizeof(gnss));
+  if (nread != sizeof(gnss) || gnss.time_utc == 0)
+    {
+      return;
+    }
+
+  flags = enter_critical_section();
+  pulse = g_pps.npulses;
+
+  /* Only trust a fix that arrived after the edge it is labelling */
+
+  if (gnss.timestamp * NSEC_PER_USEC >= g_pps.mono_ns)
+    {
+      g_pps.label_pulse = pulse;
+      g_pps.label_sec   = gnss.time_utc / USEC_PER_SEC; /* us since epoch */
+      g_pps.labelled    = true;
+    }
+
+  leave_critical_section(flags);
+}
+
+/****************************************************************************
+ * Name: pps_interrupt
+ *
+ * Description:
+ *   TIM5 CH1 capture, a PPS rising edge.
+ *
+ ****************************************************************************/
+
+static int pps_interrupt(int irq, FAR void *context, FAR void *arg)
+{
+  uint32_t capture;
+  uint32_t delta;
+  uint64_t since;
+  uint64_t now;
+
+  /* Reading CCR1 clears the capture flag */
+
+  capture = getreg32(PPS_CCR1);
+  now     = sensor_get_timestamp() * NSEC_PER_USEC;
+  since   = pps_cycles_to_ns(getreg32(PPS_CNT) - capture);
+
+  if (g_pps.npulses > 0)
+    {
+      delta = capture - g_pps.capture;
+      if (delta > PPS_CLOCK - PPS_MAX_ERROR &&
+          delta < PPS_CLOCK + PPS_MAX_ERROR)
+        {
+          int64_t err = ((int64_t)delta << PPS_FRAC_SHIFT) -
+                        (int64_t)g_pps.freq;
+          g_pps.freq += err >> PPS_FILTER_SHIFT;
+          pps_update_scale();
+        }
+      else
+        {
+          /* A missed or spurious edge, restart the UTC labelling */
+
+          g_pps.labelled = false;
+        }
+    }
+
+  g_pps.capture = capture;
+  g_pps.mono_ns = now - since;
+  g_pps.npulses++;
+
+  work_queue(LPWORK, &g_pps.work, pps_label_worker, NULL, PPS_LABEL_DELAY);
+  return OK;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: stm32_pps_initialize
+ *
+ * Description:
+ *   Start TIM5 free-running and capture the GNSS PPS on CH1.
+ *
+ ****************************************************************************/
+
+int stm32_pps_initialize(void)
+{
+  int ret;
+
+  g_pps.freq = (uint64_t)PPS_CLOCK << PPS_FRAC_SHIFT;
+  pps_update_scale();
+
+  g_pps.tim = stm32_tim_init(JOSH_PPS_TIMER);
+  if (g_pps.tim == NULL)
+    {
+      tmrerr("ERROR: Failed to get TIM%d\n", JOSH_PPS_TIMER);
+      return -ENODEV;
+    }
+
+  ret = STM32_TIM_SETCLOCK(g_pps.tim, PPS_CLOCK);
+  if (ret < 0)
+    {
+      stm32_tim_deinit(g_pps.tim);
+      return ret;
+    }
+
+  STM32_TIM_SETPERIOD(g_pps.tim, UINT32_MAX);
+
+  /* CH1 input capture from TI1, rising edge, no filter or prescaler */
+
+  stm32_configgpio(GPIO_GNSS_PPS);
+  modifyreg32(PPS_CCMR1, GTIM_CCMR1_CC1S_MASK,
+              GTIM_CCMR_CCS_CCIN1 << GTIM_CCMR1_CC1S_SHIFT);
+  modifyreg32(PPS_CCER, GTIM_CCER_CC1P | GTIM_CCER_CC1NP, GTIM_CCER_CC1E);
+
+  ret = STM32_TIM_SETISR(g_pps.tim, pps_interrupt, NULL, 0);
+  if (ret < 0)
+    {
+      stm32_tim_deinit(g_pps.tim);
+      return ret;
+    }
+
+  STM32_TIM_ENABLEINT(g_pps.tim, GTIM_DIER_CC1IE);
+  STM32_TIM_SETMODE(g_pps.tim, STM32_TIM_MODE_UP);
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: stm32_pps_gettime
+ *
+ * Description:
+ *   Return the current UTC time, interpolated from the last PPS edge with
+ *   the GNSS-measured TIM5 frequency.
+ *
+ * Returned Value:
+ *   OK, or -EAGAIN if the timebase is not locked to GNSS.
+ *
+ ****************************************************************************/
+
+int stm32_pps_gettime(FAR struct timespec *utc)
+{
+  irqstate_t flags;
+  uint64_t sec;
+  uint64_t ns;
+  int ret = -EAGAIN;
+
+  flags = enter_critical_section();
+
+  if (g_pps.labelled &&
+      sensor_get_timestamp() * NSEC_PER_USEC - g_pps.mono_ns <
+      PPS_TIMEOUT_NS)
+    {
+      ns  = pps_cycles_to_ns(getreg32(PPS_CNT) - g_pps.capture);
+      sec = g_pps.label_sec + (g_pps.npulses - g_pps.label_pulse);
+
+      utc->tv_sec  = sec + ns / NSEC_PER_SEC;
+      utc->tv_nsec = ns % NSEC_PER_SEC;
+      ret = OK;
+    }
+
+  leave_critical_section(flags);
+  return ret;
+}
+
+/****************************************************************************
+ * Name: stm32_pps_status
+ *
+ * Description:
+ *   Report the UTC offset of the monotonic sensor clock and the drift of
+ *   the local oscillator measured against GNSS.
+ *
+ ****************************************************************************/
+
+int stm32_pps_status(FAR struct josh_pps_status_s *status)
+{
+  irqstate_t flags;
+  uint64_t utc_ns;
+
+  flags = enter_critical_section();
+
+  status->npulses   = g_pps.npulses;
+  status->drift_ppb = (int32_t)
+    (((int64_t)g_pps.freq - ((int64_t)PPS_CLOCK << PPS_FRAC_SHIFT)) *
+     1000000000ll / ((int64_t)PPS_CLOCK << PPS_FRAC_SHIFT));
+  status->locked    = g_pps.labelled &&
+                      sensor_get_timestamp() * NSEC_PER_USEC -
+                      g_pps.mono_ns < PPS_TIMEOUT_NS;
+
+  if (status->locked)
+    {
+      utc_ns = (g_pps.label_sec + (g_pps.npulses - g_pps.label_pulse)) *
+               NSEC_PER_SEC;
+      status->utc_offset_ns = (int64_t)(utc_ns - g_pps.mono_ns);
+    }
+  else
+    {
+      status->utc_offset_ns = 0;
+    }
+
+  leave_critical_section(flags);
+  return status->locked ? OK : -EAGAIN;
+}
+
+#endif /* CONFIG_JOSH_PPS */
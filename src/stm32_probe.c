@@ -0,0 +1,148 @@
+/****************************************************************************
+ * boards/arm/stm32h7/josh/src/stm32_probe.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/* Scope probe outputs for measuring interrupt load and latency with a logic
+ * analyser. The OS marks interrupts, signal delivery and idle through the
+ * LED_INIRQ, LED_SIGNAL and LED_IDLE autoled calls; see stm32_autoleds.c.
+ * This file adds the driver hooks.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <nuttx/irq.h>
+#include <nuttx/wqueue.h>
+#include <arch/board/board.h>
+
+#include "arm_internal.h"
+#include "chip.h"
+#include "stm32_gpio.h"
+#include "josh.h"
+
+#ifdef CONFIG_JOSH_PROBE
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#if defined(CONFIG_JOSH_PROBE_IMU) && CONFIG_SCHED_HPNTHREADS > 1
+#  error "CONFIG_JOSH_PROBE_IMU needs a single HPWORK thread"
+#endif
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_PROBE_IMU
+struct probe_hook_s
+{
+  xcpt_t handler;         /* Driver's data-ready handler */
+  FAR void *arg;
+  struct work_s work;     /* Queued behind the driver's read */
+};
+#endif
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_PROBE_IMU
+static struct probe_hook_s g_probe_imu;
+#endif
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: probe_imu_done
+ *
+ * Description:
+ *   Runs on HPWORK after the driver's read and publish work, which was
+ *   queued ahead of it in the same interrupt.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_PROBE_IMU
+static void probe_imu_done(FAR void *arg)
+{
+  stm32_probe_low(JOSH_PROBE_IMU);
+}
+#endif
+
+/****************************************************************************
+ * Name: probe_imu_interrupt
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_PROBE_IMU
+static int probe_imu_interrupt(int irq, FAR void *context, FAR void *arg)
+{
+  FAR struct probe_hook_s *hook = (FAR struct probe_hook_s *)arg;
+  int ret;
+
+  stm32_probe_high(JOSH_PROBE_IMU);
+
+  ret = hook->handler(irq, context, hook->arg);
+  work_queue(HPWORK, &hook->work, probe_imu_done, NULL, 0);
+  return ret;
+}
+#endif
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: stm32_probe_initialize
+ ****************************************************************************/
+
+void stm32_probe_initialize(void)
+{
+  stm32_configgpio(GPIO_PROBE(JOSH_PROBE_IRQ));
+  stm32_configgpio(GPIO_PROBE(JOSH_PROBE_SIGNAL));
+  stm32_configgpio(GPIO_PROBE(JOSH_PROBE_IDLE));
+  stm32_configgpio(GPIO_PROBE(JOSH_PROBE_IMU));
+}
+
+/****************************************************************************
+ * Name: stm32_probe_imu
+ *
+ * Description:
+ *   Replace the IMU data-ready handler and argument with the probe
+ *   wrapper. Called from the board's attach callback before the handler
+ *   is attached.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_PROBE_IMU
+void stm32_probe_imu(FAR xcpt_t *handler, FAR void **arg)
+{
+  g_probe_imu.handler = *handler;
+  g_probe_imu.arg     = *arg;
+
+  *handler = probe_imu_interrupt;
+  *arg     = &g_probe_imu;
+}
+#endif
+
+#endif /* CONFIG_JOSH_PROBE */
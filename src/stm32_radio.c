@@ -0,0 +1,795 @@
+/****************************************************************************
+ * boards/arm/stm32h7/josh/src/stm32_radio.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <sys/param.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/irq.h>
+#include <nuttx/clock.h>
+#include <nuttx/kthread.h>
+#include <nuttx/signal.h>
+#include <nuttx/semaphore.h>
+#include <nuttx/fs/fs.h>
+#include <nuttx/wireless/lpwan/rn2xx3.h>
+#include <arch/board/board.h>
+
+#include "josh.h"
+
+#ifdef CONFIG_JOSH_RADIO_FEC
+#  include "josh_frame.h"
+#endif
+
+#ifdef CONFIG_JOSH_RADIO
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define RADIO_DEVPATH      "/dev/rn2483"
+#define RADIO_QPATH        "/dev/rn2483q%d"
+
+#define RADIO_DEPTH        CONFIG_JOSH_RADIO_QUEUE_DEPTH
+#define RADIO_MTU          CONFIG_JOSH_RADIO_MTU
+
+#ifdef CONFIG_JOSH_RADIO_FEC
+#  if CONFIG_JOSH_RADIO_FEC_NROOTS % 2 != 0
+#    error "CONFIG_JOSH_RADIO_FEC_NROOTS must be even"
+#  endif
+#  if RADIO_MTU + JOSH_FRAME_OVERHEAD(CONFIG_JOSH_RADIO_FEC_NROOTS, \
+                                      CONFIG_JOSH_RADIO_FEC_DEPTH) > \
+      JOSH_FRAME_MAXLEN
+#    error "CONFIG_JOSH_RADIO_MTU too large for the FEC overhead"
+#  endif
+#endif
+
+/* Records that fit in one frame, at least one byte each */
+
+#ifdef CONFIG_JOSH_RADIO_COALESCE
+#  define RADIO_MAXRECS    (RADIO_DEPTH * JOSH_RADIO_NPRIO)
+#else
+#  define RADIO_MAXRECS    1
+#endif
+
+/* How often the modulation settings are read back from the modem, in case
+ * an application changed them through /dev/rn2483.
+ */
+
+#define RADIO_PARAM_REFRESH  SEC2TICK(10)
+
+/* Largest airtime budget that can be banked, in microseconds */
+
+#define RADIO_BUDGET_MAX   (CONFIG_JOSH_RADIO_BUDGET_MS * USEC_PER_MSEC)
+
+#ifdef CONFIG_JOSH_UPLINK
+#  define RADIO_RX_PERIOD  MSEC2TICK(CONFIG_JOSH_UPLINK_PERIOD_MS)
+#  define RADIO_OFLAGS     O_RDWR
+
+/* The RN2483 watchdog also ends transmissions, so it is only shortened for
+ * receive windows. Its 15s reset default covers the longest frame (about
+ * 9s for 255 bytes at SF12/BW125).
+ */
+
+#  define RADIO_TX_WDT_MS  15000
+#else
+#  define RADIO_OFLAGS     O_WRONLY
+#endif
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct radio_rec_s
+{
+  josh_radio_done_t done;                 /* Completion callback or NULL */
+  FAR void *arg;                          /* Callback argument */
+  uint16_t len;                           /* Payload length */
+  uint8_t data[RADIO_MTU];                /* Payload */
+};
+
+struct radio_cb_s
+{
+  josh_radio_done_t done;
+  FAR void *arg;
+};
+
+struct radio_ring_s
+{
+  struct radio_rec_s rec[RADIO_DEPTH];    /* Record ring */
+  uint8_t head;                           /* Oldest record */
+  uint8_t count;                          /* Records in the ring */
+};
+
+/* LoRa modulation, as needed for the airtime calculation */
+
+struct radio_param_s
+{
+  uint8_t sf;                             /* Spreading factor, 7-12 */
+  uint8_t cr;                             /* Coding rate 4/(4 + cr) */
+  uint16_t prlen;                         /* Preamble symbols */
+  uint32_t bw;                            /* Bandwidth, kHz */
+  bool crc;                               /* Payload CRC enabled */
+};
+
+struct radio_s
+{
+  struct radio_ring_s ring[JOSH_RADIO_NPRIO];
+  sem_t sem;                              /* Counts queued records */
+  struct file dev;                        /* RN2XX3 driver */
+  struct radio_param_s param;             /* Current modulation */
+  clock_t param_time;                     /* When param was read */
+  int64_t budget;                         /* Airtime available, us */
+  clock_t budget_time;                    /* When budget was updated */
+  clock_t start;                          /* Thread start, for stats */
+  struct josh_radio_stats_s stats;
+  uint8_t frame[RADIO_MTU];               /* Frame being transmitted */
+#ifdef CONFIG_JOSH_RADIO_FEC
+  uint8_t txbuf[JOSH_FRAME_MAXLEN];       /* Frame with header and parity */
+  uint16_t seq;                           /* Next frame sequence number */
+#endif
+  struct radio_cb_s cb[RADIO_MAXRECS];    /* Callbacks of its records */
+#ifdef CONFIG_JOSH_UPLINK
+  bool uplink;                            /* Receive windows enabled */
+  bool rx_wdt;                            /* Watchdog set for receiving */
+  clock_t rx_time;                        /* Last receive window */
+#endif
+};
+
+/****************************************************************************
+ * Private Function Prototypes
+ ****************************************************************************/
+
+static ssize_t radio_qwrite(FAR struct file *filep, FAR const char *buffer,
+                            size_t buflen);
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const struct file_operations g_radio_qops =
+{
+  .write = radio_qwrite,
+};
+
+static struct radio_s g_radio =
+{
+  .sem = SEM_INITIALIZER(0),
+};
+
+#ifdef CONFIG_JOSH_RADIO_FEC
+static const struct josh_frame_cfg_s g_radio_fec =
+{
+  .nroots = CONFIG_JOSH_RADIO_FEC_NROOTS,
+  .depth  = CONFIG_JOSH_RADIO_FEC_DEPTH,
+};
+#endif
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: radio_get_param
+ *
+ * Description:
+ *   Read the modulation settings back from the modem. Settings that can
+ *   not be read keep their previous value.
+ *
+ ****************************************************************************/
+
+static void radio_get_param(FAR struct radio_s *radio)
+{
+  FAR struct radio_param_s *param = &radio->param;
+  enum rn2xx3_cr_e cr;
+  uint32_t bw;
+  uint16_t prlen;
+  uint8_t sf;
+
+  if (file_ioctl(&radio->dev, WLIOC_GETSPREAD, (unsigned long)&sf) >= 0)
+    {
+      param->sf = sf;
+    }
+
+  if (file_ioctl(&radio->dev, WLIOC_GETBANDWIDTH,
+                 (unsigned long)&bw) >= 0)
+    {
+      param->bw = bw;
+    }
+
+  if (file_ioctl(&radio->dev, WLIOC_GETCODERATE, (unsigned long)&cr) >= 0)
+    {
+      param->cr = cr - RN2XX3_CR_4_5 + 1;
+    }
+
+  if (file_ioctl(&radio->dev, WLIOC_GETPRLEN, (unsigned long)&prlen) >= 0)
+    {
+      param->prlen = prlen;
+    }
+
+  radio->param_time = clock_systime_ticks();
+}
+
+/****************************************************************************
+ * Name: radio_airtime
+ *
+ * Description:
+ *   Time on air of a LoRa frame with 'len' payload bytes, in microseconds,
+ *   from the Semtech SX1276 datasheet formula with an explicit header.
+ *
+ ****************************************************************************/
+
+static uint32_t radio_airtime(FAR const struct radio_param_s *param,
+                              size_t len)
+{
+  uint32_t tsym;
+  int32_t num;
+  int32_t den;
+  uint32_t nsym;
+  bool de;
+
+  tsym = (USEC_PER_MSEC << param->sf) / param->bw;
+
+  /* Low data rate optimisation is mandated above 16ms symbols */
+
+  de  = tsym > 16 * USEC_PER_MSEC;
+  num = 8 * len - 4 * param->sf + 28 + (param->crc ? 16 : 0);
+  den = 4 * (param->sf - (de ? 2 : 0));
+
+  nsym = 8;
+  if (num > 0)
+    {
+      nsym += ((num + den - 1) / den) * (param->cr + 4);
+    }
+
+  /* Preamble is prlen + 4.25 symbols */
+
+  return (param->prlen * 4 + 17) * tsym / 4 + nsym * tsym;
+}
+
+#ifdef CONFIG_JOSH_UPLINK
+/****************************************************************************
+ * Name: radio_rxremaining
+ *
+ * Description:
+ *   Ticks until the next receive window is due, at least one.
+ *
+ ****************************************************************************/
+
+static sclock_t radio_rxremaining(FAR struct radio_s *radio)
+{
+  sclock_t remaining;
+
+  remaining = RADIO_RX_PERIOD -
+              (sclock_t)(clock_systime_ticks() - radio->rx_time);
+  return remaining > 0 ? remaining : 1;
+}
+
+/****************************************************************************
+ * Name: radio_rxwindow
+ *
+ * Description:
+ *   Open a receive window for uplink commands if one is due.
+ *
+ * Returned Value:
+ *   True if a window was opened.
+ *
+ ****************************************************************************/
+
+static bool radio_rxwindow(FAR struct radio_s *radio)
+{
+  irqstate_t flags;
+  int ret;
+
+  if (!radio->uplink ||
+      clock_systime_ticks() - radio->rx_time < RADIO_RX_PERIOD)
+    {
+      return false;
+    }
+
+  if (!radio->rx_wdt)
+    {
+      ret = stm32_rn2483_wdt(CONFIG_JOSH_UPLINK_WINDOW_MS);
+      if (ret < 0)
+        {
+          /* An unbounded receive would stall the transmit queue, so skip
+           * this window rather than listen without the watchdog.
+           */
+
+          wlerr("ERROR: Failed to shorten RN2483 watchdog: %d\n", ret);
+          radio->rx_time = clock_systime_ticks();
+          return true;
+        }
+
+      radio->rx_wdt = true;
+    }
+
+  ret = stm32_uplink_receive(&radio->dev);
+  radio->rx_time = clock_systime_ticks();
+
+  flags = enter_critical_section();
+  radio->stats.rx_windows++;
+  if (ret >= 0)
+    {
+      radio->stats.rx_commands++;
+    }
+  else if (ret != -ETIMEDOUT)
+    {
+      radio->stats.rx_rejected++;
+    }
+
+  leave_critical_section(flags);
+
+  return true;
+}
+#endif
+
+/****************************************************************************
+ * Name: radio_wait
+ *
+ * Description:
+ *   Wait for a queued record, opening receive windows while idle.
+ *
+ ****************************************************************************/
+
+static void radio_wait(FAR struct radio_s *radio)
+{
+#ifdef CONFIG_JOSH_UPLINK
+  if (radio->uplink)
+    {
+      do
+        {
+          radio_rxwindow(radio);
+        }
+      while (nxsem_tickwait_uninterruptible(&radio->sem,
+                                            radio_rxremaining(radio)) < 0);
+      return;
+    }
+#endif
+
+  nxsem_wait_uninterruptible(&radio->sem);
+}
+
+/****************************************************************************
+ * Name: radio_budget_wait
+ *
+ * Description:
+ *   Refill the airtime budget at the configured duty cycle and wait until
+ *   it covers 'airtime'. Then spend it.
+ *
+ *   A frame longer than the whole budget (a full frame at SF12 takes
+ *   seconds) waits for a full budget and leaves it in debt, so the duty
+ *   cycle still holds on average and the frame is not stuck forever.
+ *
+ *   The budget and stats are read by stm32_radio_stats, so they are only
+ *   updated in a critical section.
+ *
+ ****************************************************************************/
+
+static void radio_budget_wait(FAR struct radio_s *radio, uint32_t airtime)
+{
+  int64_t needed = MIN(airtime, RADIO_BUDGET_MAX);
+  irqstate_t flags;
+  clock_t now;
+  int64_t deficit;
+
+  for (; ; )
+    {
+      flags = enter_critical_section();
+
+      now = clock_systime_ticks();
+      radio->budget += TICK2USEC(now - radio->budget_time) *
+                       CONFIG_JOSH_RADIO_DUTY_PERMILLE / 1000;
+      radio->budget_time = now;
+
+      if (radio->budget > RADIO_BUDGET_MAX)
+        {
+          radio->budget = RADIO_BUDGET_MAX;
+        }
+
+      deficit = needed - radio->budget;
+      if (deficit <= 0)
+        {
+          /* Spent whether or not the modem then takes the frame */
+
+          radio->budget -= airtime;
+          leave_critical_section(flags);
+          break;
+        }
+
+      radio->stats.throttled++;
+      leave_critical_section(flags);
+
+#ifdef CONFIG_JOSH_UPLINK
+      /* Listen while the budget refills */
+
+      if (radio_rxwindow(radio))
+        {
+          continue;
+        }
+#endif
+
+      nxsig_usleep(deficit * 1000 / CONFIG_JOSH_RADIO_DUTY_PERMILLE);
+    }
+}
+
+/****************************************************************************
+ * Name: radio_take
+ *
+ * Description:
+ *   Move the oldest record of the highest priority into the frame at
+ *   'offset', if it fits, and free its ring slot.
+ *
+ * Returned Value:
+ *   The record's length, or 0 if it does not fit.
+ *
+ ****************************************************************************/
+
+static size_t radio_take(FAR struct radio_s *radio, size_t offset,
+                         FAR struct radio_cb_s *cb)
+{
+  FAR struct radio_ring_s *ring;
+  FAR struct radio_rec_s *rec;
+  irqstate_t flags;
+  size_t len = 0;
+  int prio;
+
+  flags = enter_critical_section();
+  for (prio = 0; prio < JOSH_RADIO_NPRIO; prio++)
+    {
+      ring = &radio->ring[prio];
+      if (ring->count == 0)
+        {
+          continue;
+        }
+
+      /* If the next record does not fit, stop: a lower priority record
+       * must not jump ahead of one that is waiting for a frame of its own.
+       */
+
+      rec = &ring->rec[ring->head];
+      if (rec->len <= RADIO_MTU - offset)
+        {
+          memcpy(&radio->frame[offset], rec->data, rec->len);
+          len      = rec->len;
+          cb->done = rec->done;
+          cb->arg  = rec->arg;
+
+          ring->head = (ring->head + 1) % RADIO_DEPTH;
+          ring->count--;
+        }
+
+      break;
+    }
+
+  leave_critical_section(flags);
+  return len;
+}
+
+/****************************************************************************
+ * Name: radio_thread
+ *
+ * Description:
+ *   Assemble frames from the priority rings, highest priority first,
+ *   filling each frame with as many whole records as fit. Each frame is
+ *   held back until the duty-cycle budget covers its airtime, then handed
+ *   to the RN2XX3 driver, which blocks until the module reports the
+ *   result. The completion callbacks of its records run after that.
+ *
+ ****************************************************************************/
+
+static int radio_thread(int argc, FAR char *argv[])
+{
+  FAR struct radio_s *radio = &g_radio;
+  FAR const uint8_t *txbuf;
+  irqstate_t flags;
+  uint32_t airtime;
+  ssize_t nwritten;
+  size_t offset;
+  size_t txlen;
+  size_t len;
+  int nrecs;
+  int ret;
+  int i;
+
+  ret = file_open(&radio->dev, RADIO_DEVPATH, RADIO_OFLAGS);
+  if (ret < 0)
+    {
+      wlerr("ERROR: Failed to open %s: %d\n", RADIO_DEVPATH, ret);
+      return ret;
+    }
+
+  radio->param.sf    = 7;
+  radio->param.cr    = 1;
+  radio->param.prlen = 8;
+  radio->param.bw    = 125;
+  radio->param.crc   = true;
+  radio_get_param(radio);
+
+  flags = enter_critical_section();
+  radio->start       = clock_systime_ticks();
+  radio->budget_time = radio->start;
+  radio->budget      = RADIO_BUDGET_MAX;
+  leave_critical_section(flags);
+
+#ifdef CONFIG_JOSH_UPLINK
+  radio->uplink  = stm32_uplink_initialize() >= 0;
+  radio->rx_time = radio->start;
+#endif
+
+  for (; ; )
+    {
+      radio_wait(radio);
+
+      if (clock_systime_ticks() - radio->param_time >= RADIO_PARAM_REFRESH)
+        {
+          radio_get_param(radio);
+        }
+
+      offset = radio_take(radio, 0, &radio->cb[0]);
+      nrecs  = 1;
+
+#ifdef CONFIG_JOSH_RADIO_COALESCE
+      /* Records are concatenated as they are, so they must carry their
+       * own framing for the ground station to split them.
+       */
+
+      while (nrecs < RADIO_MAXRECS && nxsem_trywait(&radio->sem) >= 0)
+        {
+          len = radio_take(radio, offset, &radio->cb[nrecs]);
+          if (len == 0)
+            {
+              nxsem_post(&radio->sem);
+              break;
+            }
+
+          offset += len;
+          nrecs++;
+        }
+#else
+      UNUSED(len);
+#endif
+
+#ifdef CONFIG_JOSH_RADIO_FEC
+      /* The MTU is checked against the overhead at build time */
+
+      ret = josh_frame_encode(&g_radio_fec, radio->seq++, radio->frame,
+                              offset, radio->txbuf, sizeof(radio->txbuf));
+      DEBUGASSERT(ret > 0);
+
+      txbuf = radio->txbuf;
+      txlen = ret;
+#else
+      txbuf = radio->frame;
+      txlen = offset;
+#endif
+
+      airtime = radio_airtime(&radio->param, txlen);
+      radio_budget_wait(radio, airtime);
+
+#ifdef CONFIG_JOSH_UPLINK
+      if (radio->rx_wdt)
+        {
+          ret = stm32_rn2483_wdt(RADIO_TX_WDT_MS);
+          if (ret < 0)
+            {
+              wlerr("ERROR: Failed to restore RN2483 watchdog: %d\n", ret);
+            }
+
+          radio->rx_wdt = ret < 0;
+        }
+#endif
+
+      nwritten = file_write(&radio->dev, txbuf, txlen);
+      if (nwritten >= 0 && nwritten != txlen)
+        {
+          nwritten = -EIO;
+        }
+
+      flags = enter_critical_section();
+      if (nwritten < 0)
+        {
+          radio->stats.errors++;
+        }
+      else
+        {
+          radio->stats.frames++;
+          radio->stats.records    += nrecs;
+          radio->stats.airtime_us += airtime;
+        }
+
+      leave_critical_section(flags);
+
+      for (i = 0; i < nrecs; i++)
+        {
+          if (radio->cb[i].done != NULL)
+            {
+              radio->cb[i].done(radio->cb[i].arg,
+                                nwritten < 0 ? nwritten : OK);
+            }
+        }
+    }
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: radio_qwrite
+ *
+ * Description:
+ *   Queue one record from user space without waiting for the modem. The
+ *   priority is set by the device node written to.
+ *
+ ****************************************************************************/
+
+static ssize_t radio_qwrite(FAR struct file *filep, FAR const char *buffer,
+                            size_t buflen)
+{
+  enum josh_radio_prio_e prio;
+  int ret;
+
+  prio = (enum josh_radio_prio_e)(uintptr_t)filep->f_inode->i_private;
+  ret  = stm32_radio_submit(prio, buffer, buflen, NULL, NULL);
+  return ret < 0 ? ret : buflen;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: stm32_radio_submit
+ *
+ * Description:
+ *   Queue a record for transmission at priority 'prio' and return
+ *   immediately. 'done' is called from the radio thread with the result
+ *   of the frame that carried the record.
+ *
+ * Returned Value:
+ *   OK on success, -EAGAIN if the priority's queue is full, -EMSGSIZE if
+ *   the record does not fit in one radio frame.
+ *
+ ****************************************************************************/
+
+int stm32_radio_submit(enum josh_radio_prio_e prio, FAR const void *buf,
+                       size_t len, josh_radio_done_t done, FAR void *arg)
+{
+  FAR struct radio_s *radio = &g_radio;
+  FAR struct radio_ring_s *ring;
+  FAR struct radio_rec_s *rec;
+  irqstate_t flags;
+
+  if (prio < 0 || prio >= JOSH_RADIO_NPRIO)
+    {
+      return -EINVAL;
+    }
+
+  if (len == 0 || len > RADIO_MTU)
+    {
+      return -EMSGSIZE;
+    }
+
+  ring  = &radio->ring[prio];
+  flags = enter_critical_section();
+  if (ring->count >= RADIO_DEPTH)
+    {
+      radio->stats.dropped++;
+      leave_critical_section(flags);
+      return -EAGAIN;
+    }
+
+  /* Fill the slot before publishing it, so a concurrent submitter that
+   * posts first can not hand the thread a half written record.
+   */
+
+  rec = &ring->rec[(ring->head + ring->count) % RADIO_DEPTH];
+  memcpy(rec->data, buf, len);
+  rec->len  = len;
+  rec->done = done;
+  rec->arg  = arg;
+  ring->count++;
+  leave_critical_section(flags);
+
+  nxsem_post(&radio->sem);
+  return OK;
+}
+
+/****************************************************************************
+ * Name: stm32_radio_stats
+ *
+ * Description:
+ *   Return transmit statistics, including the fraction of time on air
+ *   since the radio thread started.
+ *
+ ****************************************************************************/
+
+int stm32_radio_stats(FAR struct josh_radio_stats_s *stats)
+{
+  FAR struct radio_s *radio = &g_radio;
+  uint64_t elapsed;
+  irqstate_t flags;
+  int prio;
+
+  flags = enter_critical_section();
+  *stats = radio->stats;
+  for (prio = 0; prio < JOSH_RADIO_NPRIO; prio++)
+    {
+      stats->queued[prio] = radio->ring[prio].count;
+    }
+
+  elapsed = TICK2USEC(clock_systime_ticks() - radio->start);
+  stats->budget_us = radio->budget > 0 ? radio->budget : 0;
+  leave_critical_section(flags);
+
+  stats->utilization_permille = elapsed > 0 ?
+    stats->airtime_us * 1000 / elapsed : 0;
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: stm32_radio_initialize
+ *
+ * Description:
+ *   Start the radio transmit thread and register the non-blocking queues
+ *   at /dev/rn2483q0 (flight critical), /dev/rn2483q1 (GNSS) and
+ *   /dev/rn2483q2 (bulk sensor data). Must be called after the RN2XX3
+ *   driver is registered.
+ *
+ ****************************************************************************/
+
+int stm32_radio_initialize(void)
+{
+  char path[16];
+  int prio;
+  int ret;
+
+  ret = kthread_create("radio", CONFIG_JOSH_RADIO_PRIORITY,
+                       CONFIG_JOSH_RADIO_STACKSIZE, radio_thread, NULL);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  for (prio = 0; prio < JOSH_RADIO_NPRIO; prio++)
+    {
+      snprintf(path, sizeof(path), RADIO_QPATH, prio);
+      ret = register_driver(path, &g_radio_qops, 0222,
+                            (FAR void *)(uintptr_t)prio);
+      if (ret < 0)
+        {
+          return ret;
+        }
+    }
+
+  return OK;
+}
+
+#endif /* CONFIG_JOSH_RADIO */
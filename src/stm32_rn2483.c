@@ -0,0 +1,279 @@
+/****************************************************************************
+ * boards/arm/stm32h7/josh/src/stm32_rn2483.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <debug.h>
+#include <termios.h>
+
+#include <sys/param.h>
+#include <sys/ioctl.h>
+
+#include <nuttx/clock.h>
+#include <nuttx/signal.h>
+#include <nuttx/serial/tioctl.h>
+#include <nuttx/fs/fs.h>
+
+#include "josh.h"
+
+#if defined(CONFIG_JOSH_RADIO_AUTOBAUD) || defined(CONFIG_JOSH_UPLINK)
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define RN2483_DEVPATH     "/dev/ttyS1"
+
+/* The module boots at 57600 and re-detects the rate after a break */
+
+#define RN2483_BOOT_BAUD   57600
+#define RN2483_BREAK_MS    2
+#define RN2483_REPLY_MS    200
+#define RN2483_POLL_MS     5
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_RADIO_AUTOBAUD
+/* Rates to try, fastest first */
+
+static const speed_t g_rn2483_bauds[] =
+{
+  460800, 230400, 115200, RN2483_BOOT_BAUD,
+};
+#endif
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: rn2483_expect
+ *
+ * Description:
+ *   Wait up to RN2483_REPLY_MS for a reply containing 'expect'.
+ *
+ ****************************************************************************/
+
+static bool rn2483_expect(FAR struct file *filep, FAR const char *expect)
+{
+  char buf[32];
+  size_t len = 0;
+  ssize_t nread;
+  int waited;
+
+  for (waited = 0; waited < RN2483_REPLY_MS; waited += RN2483_POLL_MS)
+    {
+      nread = file_read(filep, &buf[len], sizeof(buf) - 1 - len);
+      if (nread > 0)
+        {
+          len += nread;
+          buf[len] = '\0';
+          if (strstr(buf, expect) != NULL)
+            {
+              return true;
+            }
+
+          if (len == sizeof(buf) - 1)
+            {
+              len = 0;
+            }
+        }
+
+      nxsig_usleep(RN2483_POLL_MS * USEC_PER_MSEC);
+    }
+
+  return false;
+}
+
+#ifdef CONFIG_JOSH_RADIO_AUTOBAUD
+/****************************************************************************
+ * Name: rn2483_setbaud
+ ****************************************************************************/
+
+static int rn2483_setbaud(FAR struct file *filep, speed_t baud)
+{
+  struct termios tio;
+  int ret;
+
+  ret = file_ioctl(filep, TCGETS, (unsigned long)&tio);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  cfsetspeed(&tio, baud);
+  return file_ioctl(filep, TCSETS, (unsigned long)&tio);
+}
+
+/****************************************************************************
+ * Name: rn2483_autobaud
+ *
+ * Description:
+ *   Run the module's autobaud sequence at the current UART rate: a break,
+ *   then 0x55 for the module to measure. Confirm with a version query.
+ *
+ ****************************************************************************/
+
+static bool rn2483_autobaud(FAR struct file *filep)
+{
+  static const char sync = 0x55;
+  static const char query[] = "sys get ver\r\n";
+
+  if (file_ioctl(filep, TIOCSBRK, 0) < 0)
+    {
+      return false;
+    }
+
+  nxsig_usleep(RN2483_BREAK_MS * USEC_PER_MSEC);
+  file_ioctl(filep, TIOCCBRK, 0);
+
+  file_write(filep, &sync, 1);
+  nxsig_usleep(RN2483_POLL_MS * USEC_PER_MSEC);
+  file_ioctl(filep, TCFLSH, TCIFLUSH);
+
+  file_write(filep, query, sizeof(query) - 1);
+  return rn2483_expect(filep, "RN2");
+}
+#endif
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_RADIO_AUTOBAUD
+/****************************************************************************
+ * Name: stm32_rn2483_autobaud
+ *
+ * Description:
+ *   Move the RN2483 link to the fastest rate up to
+ *   CONFIG_JOSH_RADIO_AUTOBAUD_MAX that the module locks to, falling back
+ *   to its 57600 boot rate. Must be called before the RN2XX3 driver is
+ *   registered on USART2; the rate stays set on the serial port.
+ *
+ * Returned Value:
+ *   The baud rate in use, or a negated errno if the module did not answer
+ *   at any rate.
+ *
+ ****************************************************************************/
+
+int stm32_rn2483_autobaud(void)
+{
+  struct file filep;
+  int ret;
+  int i;
+
+  ret = file_open(&filep, RN2483_DEVPATH, O_RDWR | O_NONBLOCK);
+  if (ret < 0)
+    {
+      wlerr("ERROR: Failed to open %s: %d\n", RN2483_DEVPATH, ret);
+      return ret;
+    }
+
+  ret = -ENODEV;
+  for (i = 0; i < nitems(g_rn2483_bauds); i++)
+    {
+      if (g_rn2483_bauds[i] > CONFIG_JOSH_RADIO_AUTOBAUD_MAX)
+        {
+          continue;
+        }
+
+      if (rn2483_setbaud(&filep, g_rn2483_bauds[i]) < 0)
+        {
+          continue;
+        }
+
+      if (rn2483_autobaud(&filep))
+        {
+          wlinfo("RN2483 at %d baud\n", (int)g_rn2483_bauds[i]);
+          ret = g_rn2483_bauds[i];
+          break;
+        }
+    }
+
+  if (ret < 0)
+    {
+      /* Leave the port where a freshly reset module expects it */
+
+      rn2483_setbaud(&filep, RN2483_BOOT_BAUD);
+    }
+
+  file_close(&filep);
+  return ret;
+}
+#endif
+
+#ifdef CONFIG_JOSH_UPLINK
+/****************************************************************************
+ * Name: stm32_rn2483_wdt
+ *
+ * Description:
+ *   Set the module's radio watchdog, which ends a receive or a transmit
+ *   started through /dev/rn2483 after 'ms' milliseconds. The same watchdog
+ *   covers both, so the radio thread shortens it for receive windows and
+ *   restores it before transmitting. Talks to the module directly, so it
+ *   must only be called while no RN2XX3 driver operation is in progress.
+ *
+ ****************************************************************************/
+
+int stm32_rn2483_wdt(unsigned int ms)
+{
+  static const char pause[] = "mac pause\r\n";
+  struct file filep;
+  char cmd[32];
+  int len;
+  int ret;
+
+  ret = file_open(&filep, RN2483_DEVPATH, O_RDWR | O_NONBLOCK);
+  if (ret < 0)
+    {
+      wlerr("ERROR: Failed to open %s: %d\n", RN2483_DEVPATH, ret);
+      return ret;
+    }
+
+  /* Radio commands are refused while the LoRaWAN stack is running. Pause
+   * answers with how long it will stay paused.
+   */
+
+  file_ioctl(&filep, TCFLSH, TCIFLUSH);
+  file_write(&filep, pause, sizeof(pause) - 1);
+  rn2483_expect(&filep, "\n");
+
+  len = snprintf(cmd, sizeof(cmd), "radio set wdt %u\r\n", ms);
+  file_write(&filep, cmd, len);
+  ret = rn2483_expect(&filep, "ok") ? OK : -EIO;
+
+  file_close(&filep);
+  return ret;
+}
+#endif
+
+#endif /* CONFIG_JOSH_RADIO_AUTOBAUD || CONFIG_JOSH_UPLINK */
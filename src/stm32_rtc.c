@@ -0,0 +1,178 @@
+/****************************************************************************
+ * boards/arm/stm32h7/josh/src/stm32_rtc.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/clock.h>
+#include <nuttx/wqueue.h>
+#include <nuttx/fs/fs.h>
+#include <nuttx/timers/rtc.h>
+#include <nuttx/sensors/sensor.h>
+
+#include "stm32_rtc.h"
+#include "josh.h"
+
+#ifdef HAVE_RTC_DRIVER
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define RTC_GNSS_TOPIC     "/dev/uorb/sensor_gnss0"
+#define RTC_GNSS_POLL      SEC2TICK(1)
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_RTC_GNSS_SYNC
+static struct work_s g_rtc_work;
+static struct file g_rtc_gnss;
+static bool g_rtc_subscribed;
+#endif
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_RTC_GNSS_SYNC
+/****************************************************************************
+ * Name: rtc_gnss_worker
+ *
+ * Description:
+ *   Poll the GNSS topic until the first fix with a valid UTC time, then set
+ *   the system clock (and with it the RTC) from it. The PPS-disciplined
+ *   timebase is used instead when it is locked.
+ *
+ ****************************************************************************/
+
+static void rtc_gnss_worker(FAR void *arg)
+{
+  struct sensor_gnss gnss;
+  struct timespec ts;
+  ssize_t nread;
+  int ret;
+
+  if (!g_rtc_subscribed)
+    {
+      ret = file_open(&g_rtc_gnss, RTC_GNSS_TOPIC, O_RDONLY | O_NONBLOCK);
+      if (ret < 0)
+        {
+          goto again;
+        }
+
+      g_rtc_subscribed = true;
+    }
+
+  nread = file_read(&g_rtc_gnss, &gnss, sizeof(gnss));
+  if (nread != sizeof(gnss) || gnss.time_utc == 0)
+    {
+      goto again;
+    }
+
+#ifdef CONFIG_JOSH_PPS
+  if (stm32_pps_gettime(&ts) < 0)
+#endif
+    {
+      /* time_utc is in microseconds since the epoch. Advance it by the age
+       * of the fix.
+       */
+
+      uint64_t utc = gnss.time_utc + (sensor_get_timestamp() -
+                                      gnss.timestamp);
+
+      ts.tv_sec  = utc / USEC_PER_SEC;
+      ts.tv_nsec = (utc % USEC_PER_SEC) * NSEC_PER_USEC;
+    }
+
+  /* clock_settime() also writes the RTC */
+
+  ret = clock_settime(CLOCK_REALTIME, &ts);
+  if (ret < 0)
+    {
+      rtcerr("ERROR: Failed to set time from GNSS: %d\n", -errno);
+      goto again;
+    }
+
+  rtcinfo("RTC set from GNSS: %lld\n", (long long)ts.tv_sec);
+  file_close(&g_rtc_gnss);
+  g_rtc_subscribed = false;
+  return;
+
+again:
+  work_queue(LPWORK, &g_rtc_work, rtc_gnss_worker, NULL, RTC_GNSS_POLL);
+}
+#endif /* CONFIG_JOSH_RTC_GNSS_SYNC */
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: stm32_rtc_initialize
+ *
+ * Description:
+ *   Register the LSE-backed STM32H7 RTC as /dev/rtc0 and start waiting for
+ *   the first GNSS fix to set it. Wall time has already been restored from
+ *   the RTC by clock_initialize() by the time this is called.
+ *
+ ****************************************************************************/
+
+int stm32_rtc_initialize(void)
+{
+  FAR struct rtc_lowerhalf_s *lower;
+  struct timespec ts;
+  int ret;
+
+  lower = stm32_rtc_lowerhalf();
+  if (lower == NULL)
+    {
+      return -ENODEV;
+    }
+
+  ret = rtc_initialize(0, lower);
+  if (ret < 0)
+    {
+      rtcerr("ERROR: rtc_initialize failed: %d\n", ret);
+      return ret;
+    }
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  rtcinfo("Wall time restored from RTC: %lld\n", (long long)ts.tv_sec);
+
+#ifdef CONFIG_JOSH_RTC_GNSS_SYNC
+  work_queue(LPWORK, &g_rtc_work, rtc_gnss_worker, NULL, 0);
+#endif
+
+  return OK;
+}
+
+#endif /* HAVE_RTC_DRIVER */
@@ -0,0 +1,242 @@
+/****************************************************************************
+ * boards/arm/stm32h7/josh/src/stm32_sampling.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/irq.h>
+#include <nuttx/sensors/sensor.h>
+#include <arch/board/board.h>
+
+#include "chip.h"
+#include "stm32_tim.h"
+#include "josh.h"
+
+#ifdef CONFIG_JOSH_SAMPLING
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* The sampling timer counts at 1MHz so that every base frequency up to the
+ * maximum IMU output data rate has an exact microsecond period. The period
+ * must fit the 16-bit auto-reload register, hence the 16Hz minimum.
+ */
+
+#define SAMPLING_CLOCK  1000000
+#define SAMPLING_PERIOD (SAMPLING_CLOCK / CONFIG_JOSH_SAMPLING_FREQUENCY)
+
+#if SAMPLING_PERIOD > 65536
+#  error "CONFIG_JOSH_SAMPLING_FREQUENCY is too low for TIM6"
+#endif
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct sampling_slot_s
+{
+  xcpt_t handler;    /* Sensor driver's data-ready handler */
+  FAR void *arg;     /* Argument for the handler */
+  uint16_t divider;  /* Trigger every 'divider' ticks */
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct stm32_tim_dev_s *g_sampling_tim;
+static uint64_t g_sampling_timestamp;
+static uint32_t g_sampling_tick;
+
+static struct sampling_slot_s g_sampling_slots[JOSH_SAMPLE_NSOURCES] =
+{
+  [JOSH_SAMPLE_XL] =
+  {
+    .divider = CONFIG_JOSH_SAMPLING_XL_DIVIDER
+  },
+  [JOSH_SAMPLE_GY] =
+  {
+    .divider = CONFIG_JOSH_SAMPLING_GY_DIVIDER
+  },
+  [JOSH_SAMPLE_MAG] =
+  {
+    .divider = CONFIG_JOSH_SAMPLING_MAG_DIVIDER
+  },
+  [JOSH_SAMPLE_BARO] =
+  {
+    .divider = CONFIG_JOSH_SAMPLING_BARO_DIVIDER
+  },
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: stm32_sampling_interrupt
+ *
+ * Description:
+ *   Sampling timer update interrupt. Every source whose divider elapses on
+ *   this tick is triggered, so all of them are read at the same instant.
+ *   The barometer starts its conversion here; the IMU and magnetometer
+ *   free-run, so the tick only reads their latest result.
+ *
+ ****************************************************************************/
+
+static int stm32_sampling_interrupt(int irq, FAR void *context,
+                                    FAR void *arg)
+{
+  FAR struct sampling_slot_s *slot;
+  int i;
+
+  STM32_TIM_ACKINT(g_sampling_tim, GTIM_SR_UIF);
+
+  g_sampling_timestamp = sensor_get_timestamp();
+
+  for (i = 0; i < JOSH_SAMPLE_NSOURCES; i++)
+    {
+      slot = &g_sampling_slots[i];
+      if (slot->handler != NULL && (g_sampling_tick % slot->divider) == 0)
+        {
+          slot->handler(irq, context, slot->arg);
+        }
+    }
+
+  g_sampling_tick++;
+  return OK;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: stm32_sampling_attach
+ *
+ * Description:
+ *   Attach a sensor trigger to the sampling timer. The handler is called
+ *   from the timer interrupt every time the source's rate divider elapses,
+ *   in place of the sensor's own data-ready interrupt.
+ *
+ ****************************************************************************/
+
+int stm32_sampling_attach(enum josh_sample_src_e src, xcpt_t handler,
+                          FAR void *arg)
+{
+  irqstate_t flags;
+
+  if (src < 0 || src >= JOSH_SAMPLE_NSOURCES)
+    {
+      return -EINVAL;
+    }
+
+  flags = enter_critical_section();
+  g_sampling_slots[src].handler = handler;
+  g_sampling_slots[src].arg     = arg;
+  leave_critical_section(flags);
+
+  sninfo("Sampling source %d attached, every %u ticks\n", src,
+         g_sampling_slots[src].divider);
+  return OK;
+}
+
+/****************************************************************************
+ * Name: stm32_sampling_start
+ *
+ * Description:
+ *   Start the sampling timer once all sensors have been attached.
+ *
+ ****************************************************************************/
+
+int stm32_sampling_start(void)
+{
+  int ret;
+
+  if (g_sampling_tim != NULL)
+    {
+      return OK;
+    }
+
+  g_sampling_tim = stm32_tim_init(JOSH_SAMPLING_TIMER);
+  if (g_sampling_tim == NULL)
+    {
+      snerr("ERROR: Failed to get TIM%d\n", JOSH_SAMPLING_TIMER);
+      return -ENODEV;
+    }
+
+  ret = STM32_TIM_SETCLOCK(g_sampling_tim, SAMPLING_CLOCK);
+  if (ret < 0)
+    {
+      snerr("ERROR: Failed to set sampling clock: %d\n", ret);
+      stm32_tim_deinit(g_sampling_tim);
+      g_sampling_tim = NULL;
+      return ret;
+    }
+
+  STM32_TIM_SETMODE(g_sampling_tim, STM32_TIM_MODE_UP);
+  STM32_TIM_SETPERIOD(g_sampling_tim, SAMPLING_PERIOD - 1);
+
+  ret = STM32_TIM_SETISR(g_sampling_tim, stm32_sampling_interrupt, NULL, 0);
+  if (ret < 0)
+    {
+      snerr("ERROR: Failed to attach sampling interrupt: %d\n", ret);
+      stm32_tim_deinit(g_sampling_tim);
+      g_sampling_tim = NULL;
+      return ret;
+    }
+
+  STM32_TIM_ENABLEINT(g_sampling_tim, GTIM_DIER_UIE);
+
+  sninfo("Sampling timer running at %d Hz\n",
+         CONFIG_JOSH_SAMPLING_FREQUENCY);
+  return OK;
+}
+
+/****************************************************************************
+ * Name: stm32_sampling_timestamp
+ *
+ * Description:
+ *   Return the time (in microseconds) of the most recent sampling tick.
+ *   Drivers triggered from the sampling timer stamp their samples with it,
+ *   so every sample started on a tick carries the same time.
+ *
+ ****************************************************************************/
+
+uint64_t stm32_sampling_timestamp(void)
+{
+  irqstate_t flags;
+  uint64_t timestamp;
+
+  flags = enter_critical_section();
+  timestamp = g_sampling_timestamp;
+  leave_critical_section(flags);
+
+  return timestamp;
+}
+
+#endif /* CONFIG_JOSH_SAMPLING */
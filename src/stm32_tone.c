@@ -0,0 +1,520 @@
+/****************************************************************************
+ * boards/arm/stm32h7/josh/src/stm32_tone.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/* Buzzer tone sequencer on TIM1 CH3 (PE13).
+ *
+ * Every note is one burst of five words, written by DMA through TIM1_DMAR
+ * into ARR, RCR, CCR1, CCR2 and CCR3 on the timer's update event. ARR sets
+ * the pitch, CCR3 the duty (zero for a rest) and the repetition counter
+ * the number of periods, so the next update event, and the next burst,
+ * comes when the note ends. All three registers are preloaded, so each
+ * burst is written one note ahead of the note it plays.
+ *
+ * A sequence that does not loop ends on a silent note more than an hour
+ * long, so nothing has to run to stop the buzzer. The CPU is only involved
+ * to start or stop a sequence.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <sys/param.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/cache.h>
+#include <nuttx/mutex.h>
+#include <arch/board/board.h>
+
+#include "arm_internal.h"
+#include "chip.h"
+#include "stm32_gpio.h"
+#include "stm32_dma.h"
+#include "stm32_rcc.h"
+#include "hardware/stm32_tim.h"
+#include "josh.h"
+
+#ifdef CONFIG_JOSH_TONE
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define TONE_BASE         STM32_TIM1_BASE
+#define TONE_CLKIN        STM32_APB2_TIM1_CLKIN
+#define TONE_CLOCK        1000000          /* Counter clock */
+
+#define TONE_CR1          (TONE_BASE + STM32_ATIM_CR1_OFFSET)
+#define TONE_DIER         (TONE_BASE + STM32_ATIM_DIER_OFFSET)
+#define TONE_EGR          (TONE_BASE + STM32_ATIM_EGR_OFFSET)
+#define TONE_CCMR2        (TONE_BASE + STM32_ATIM_CCMR2_OFFSET)
+#define TONE_CCER         (TONE_BASE + STM32_ATIM_CCER_OFFSET)
+#define TONE_PSC          (TONE_BASE + STM32_ATIM_PSC_OFFSET)
+#define TONE_ARR          (TONE_BASE + STM32_ATIM_ARR_OFFSET)
+#define TONE_RCR          (TONE_BASE + STM32_ATIM_RCR_OFFSET)
+#define TONE_CCR3         (TONE_BASE + STM32_ATIM_CCR3_OFFSET)
+#define TONE_BDTR         (TONE_BASE + STM32_ATIM_BDTR_OFFSET)
+#define TONE_DCR          (TONE_BASE + STM32_ATIM_DCR_OFFSET)
+#define TONE_DMAR         (TONE_BASE + STM32_ATIM_DMAR_OFFSET)
+
+/* ARR, RCR, CCR1, CCR2 and CCR3 are consecutive registers */
+
+#define TONE_BURST        5
+#define TONE_DCR_DBA      (STM32_ATIM_ARR_OFFSET / 4)
+#define TONE_DCR_VALUE    (TONE_DCR_DBA << ATIM_DCR_DBA_SHIFT | \
+                           (TONE_BURST - 1) << ATIM_DCR_DBL_SHIFT)
+
+#define TONE_DMA_CONFIG   (DMA_SCR_DIR_M2P | DMA_SCR_MINC | \
+                           DMA_SCR_PSIZE_32BITS | DMA_SCR_MSIZE_32BITS | \
+                           DMA_SCR_PRILO)
+
+#define TONE_MIN_HZ       20
+#define TONE_MAX_HZ       20000
+#define TONE_MAX_PERIODS  65536            /* 16-bit repetition counter */
+
+/* One D-cache line holds 32 bytes; the burst table must not share a line
+ * with anything the CPU writes while DMA reads it.
+ */
+
+#define TONE_TABLE_WORDS  ((CONFIG_JOSH_TONE_MAXNOTES * TONE_BURST + 7) & ~7)
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct tone_burst_s
+{
+  uint32_t arr;
+  uint32_t rcr;
+  uint32_t ccr1;
+  uint32_t ccr2;
+  uint32_t ccr3;
+};
+
+struct tone_state_s
+{
+  mutex_t lock;                 /* Serialises play and stop */
+  DMA_HANDLE dma;               /* TIM1_UP stream */
+  bool dmarunning;
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct tone_state_s g_tone =
+{
+  .lock = NXMUTEX_INITIALIZER,
+};
+
+static uint32_t g_tone_table[TONE_TABLE_WORDS] aligned_data(32);
+
+/* Built in sequences */
+
+static const struct josh_tone_s g_tone_arming[] =
+{
+  { 1000, 80 }, { 0, 40 }, { 1500, 80 }, { 0, 40 }, { 2000, 160 },
+};
+
+static const struct josh_tone_s g_tone_gnss_lock[] =
+{
+  { 2500, 60 }, { 0, 60 }, { 2500, 60 },
+};
+
+static const struct josh_tone_s g_tone_beacon[] =
+{
+  { 4000, 500 }, { 0, 1500 },
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: tone_encode
+ *
+ * Description:
+ *   Convert a note to its register burst.
+ *
+ ****************************************************************************/
+
+static int tone_encode(FAR const struct josh_tone_s *tone,
+                       FAR struct tone_burst_s *burst)
+{
+  uint32_t periods;
+
+  if (tone->ms == 0)
+    {
+      return -EINVAL;
+    }
+
+  memset(burst, 0, sizeof(*burst));
+
+  if (tone->hz == 0)
+    {
+      /* A rest: 1ms periods with the output held low */
+
+      burst->arr = TONE_CLOCK / 1000 - 1;
+      periods    = tone->ms;
+    }
+  else
+    {
+      if (tone->hz < TONE_MIN_HZ || tone->hz > TONE_MAX_HZ)
+        {
+          return -EINVAL;
+        }
+
+      burst->arr  = TONE_CLOCK / tone->hz - 1;
+      burst->ccr3 = (burst->arr + 1) / 2;
+      periods     = ((uint32_t)tone->hz * tone->ms + 500) / 1000;
+      if (periods == 0)
+        {
+          periods = 1;
+        }
+    }
+
+  if (periods > TONE_MAX_PERIODS)
+    {
+      return -ERANGE;
+    }
+
+  burst->rcr = periods - 1;
+  return OK;
+}
+
+/****************************************************************************
+ * Name: tone_silence
+ *
+ * Description:
+ *   The note that ends a sequence: silent for 2^32 us.
+ *
+ ****************************************************************************/
+
+static void tone_silence(FAR struct tone_burst_s *burst)
+{
+  memset(burst, 0, sizeof(*burst));
+  burst->arr = UINT16_MAX;
+  burst->rcr = TONE_MAX_PERIODS - 1;
+}
+
+/****************************************************************************
+ * Name: tone_load
+ *
+ * Description:
+ *   Write a burst to the preload registers directly.
+ *
+ ****************************************************************************/
+
+static void tone_load(FAR const struct tone_burst_s *burst)
+{
+  putreg32(burst->arr, TONE_ARR);
+  putreg32(burst->rcr, TONE_RCR);
+  putreg32(burst->ccr3, TONE_CCR3);
+}
+
+/****************************************************************************
+ * Name: tone_dmadone
+ ****************************************************************************/
+
+static void tone_dmadone(DMA_HANDLE handle, uint8_t status, FAR void *arg)
+{
+  /* The last burst is written; the timer plays it out on its own */
+
+  g_tone.dmarunning = false;
+}
+
+/****************************************************************************
+ * Name: tone_halt
+ *
+ * Description:
+ *   Stop the timer and DMA and drive the buzzer low. Called with the lock
+ *   held.
+ *
+ ****************************************************************************/
+
+static void tone_halt(void)
+{
+  modifyreg32(TONE_DIER, ATIM_DIER_UDE, 0);
+  modifyreg32(TONE_CR1, ATIM_CR1_CEN, 0);
+
+  if (g_tone.dmarunning)
+    {
+      stm32_dmastop(g_tone.dma);
+      g_tone.dmarunning = false;
+    }
+
+  putreg32(0, TONE_CCR3);
+  putreg32(ATIM_EGR_UG, TONE_EGR);
+}
+
+/****************************************************************************
+ * Name: tone_configure
+ *
+ * Description:
+ *   Take over TIM1 from the PWM driver, which may have reset or stopped it,
+ *   and set it up for preloaded PWM on CH3 with DMA bursts.
+ *
+ ****************************************************************************/
+
+static void tone_configure(void)
+{
+  uint32_t ccmr2;
+
+  modifyreg32(STM32_RCC_APB2ENR, 0, RCC_APB2ENR_TIM1EN);
+  stm32_configgpio(GPIO_TIM1_CH3OUT);
+
+  putreg32(0, TONE_CR1);
+  putreg32(TONE_CLKIN / TONE_CLOCK - 1, TONE_PSC);
+
+  ccmr2  = getreg32(TONE_CCMR2);
+  ccmr2 &= ~(ATIM_CCMR2_OC3M_MASK | ATIM_CCMR2_CC3S_MASK);
+  ccmr2 |= (ATIM_CCMR_MODE_PWM1 << ATIM_CCMR2_OC3M_SHIFT) |
+           ATIM_CCMR2_OC3PE;
+  putreg32(ccmr2, TONE_CCMR2);
+
+  modifyreg32(TONE_CCER, 0, ATIM_CCER_CC3E);
+  modifyreg32(TONE_BDTR, 0, ATIM_BDTR_MOE);
+  putreg32(ATIM_CR1_ARPE, TONE_CR1);
+  putreg32(TONE_DCR_VALUE, TONE_DCR);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: stm32_tone_initialize
+ *
+ * Description:
+ *   Claim the TIM1 update DMA stream.
+ *
+ ****************************************************************************/
+
+int stm32_tone_initialize(void)
+{
+  if (g_tone.dma != NULL)
+    {
+      return OK;
+    }
+
+  g_tone.dma = stm32_dmachannel(DMAMAP_DMA12_TIM1UP_0);
+  if (g_tone.dma == NULL)
+    {
+      tmrerr("ERROR: No DMA stream for TIM1_UP\n");
+      return -EBUSY;
+    }
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: stm32_tone_play
+ *
+ * Description:
+ *   Start playing a tone sequence, replacing any that is playing. Returns
+ *   once the sequence is started.
+ *
+ ****************************************************************************/
+
+int stm32_tone_play(FAR const struct josh_tone_seq_s *seq)
+{
+  FAR struct tone_burst_s *table = (FAR struct tone_burst_s *)g_tone_table;
+  FAR const struct josh_tone_s *tones;
+  struct tone_burst_s first;
+  struct tone_burst_s second;
+  stm32_dmacfg_t dmacfg;
+  size_t ntones;
+  size_t nburst;
+  size_t i;
+  int ret;
+
+  if (seq == NULL)
+    {
+      return -EINVAL;
+    }
+
+  switch (seq->builtin)
+    {
+      case 0:
+        tones  = seq->tones;
+        ntones = seq->ntones;
+        break;
+
+      case JOSH_TONE_ARMING:
+        tones  = g_tone_arming;
+        ntones = nitems(g_tone_arming);
+        break;
+
+      case JOSH_TONE_GNSS_LOCK:
+        tones  = g_tone_gnss_lock;
+        ntones = nitems(g_tone_gnss_lock);
+        break;
+
+      case JOSH_TONE_BEACON:
+        tones  = g_tone_beacon;
+        ntones = nitems(g_tone_beacon);
+        break;
+
+      default:
+        return -EINVAL;
+    }
+
+  if (tones == NULL || ntones == 0 ||
+      ntones > CONFIG_JOSH_TONE_MAXNOTES)
+    {
+      return -EINVAL;
+    }
+
+  if (g_tone.dma == NULL)
+    {
+      return -ENODEV;
+    }
+
+  ret = nxmutex_lock(&g_tone.lock);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  tone_halt();
+
+  /* The first note is loaded by hand and the second preloaded, so the DMA
+   * table starts at the third. A loop wraps round to the first two; a
+   * single pass ends on the silent note.
+   */
+
+  ret = tone_encode(&tones[0], &first);
+  if (ret < 0)
+    {
+      goto out;
+    }
+
+  if (ntones > 1)
+    {
+      ret = tone_encode(&tones[1], &second);
+    }
+  else if (seq->loop)
+    {
+      second = first;
+    }
+  else
+    {
+      tone_silence(&second);
+    }
+
+  if (ret < 0)
+    {
+      goto out;
+    }
+
+  if (seq->loop)
+    {
+      nburst = ntones;
+      for (i = 0; i < nburst && ret == OK; i++)
+        {
+          ret = tone_encode(&tones[(i + 2) % ntones], &table[i]);
+        }
+    }
+  else
+    {
+      nburst = ntones - 1;
+      for (i = 0; i + 2 < ntones && ret == OK; i++)
+        {
+          ret = tone_encode(&tones[i + 2], &table[i]);
+        }
+
+      if (nburst > 0)
+        {
+          tone_silence(&table[nburst - 1]);
+        }
+    }
+
+  if (ret < 0)
+    {
+      goto out;
+    }
+
+  tone_configure();
+
+  /* Make the first note active, then preload the second */
+
+  tone_load(&first);
+  putreg32(ATIM_EGR_UG, TONE_EGR);
+  tone_load(&second);
+
+  if (nburst > 0)
+    {
+      up_clean_dcache((uintptr_t)table, (uintptr_t)&table[nburst]);
+
+      dmacfg.paddr = TONE_DMAR;
+      dmacfg.maddr = (uint32_t)(uintptr_t)table;
+      dmacfg.cfg1  = TONE_DMA_CONFIG | (seq->loop ? DMA_SCR_CIRC : 0);
+      dmacfg.cfg2  = 0;
+      dmacfg.ndata = nburst * TONE_BURST;
+
+      stm32_dmasetup(g_tone.dma, &dmacfg);
+      stm32_dmastart(g_tone.dma, tone_dmadone, NULL, false);
+      g_tone.dmarunning = true;
+
+      modifyreg32(TONE_DIER, 0, ATIM_DIER_UDE);
+    }
+
+  modifyreg32(TONE_CR1, 0, ATIM_CR1_CEN);
+
+out:
+  nxmutex_unlock(&g_tone.lock);
+  return ret;
+}
+
+/****************************************************************************
+ * Name: stm32_tone_stop
+ *
+ * Description:
+ *   Silence the buzzer, ending any sequence, looping or not.
+ *
+ ****************************************************************************/
+
+int stm32_tone_stop(void)
+{
+  int ret;
+
+  if (g_tone.dma == NULL)
+    {
+      return -ENODEV;
+    }
+
+  ret = nxmutex_lock(&g_tone.lock);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  tone_halt();
+  nxmutex_unlock(&g_tone.lock);
+  return OK;
+}
+
+#endif /* CONFIG_JOSH_TONE */
@@ -0,0 +1,328 @@
+/****************************************************************************
+ * boards/arm/stm32h7/josh/src/stm32_uplink.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/* Ground to vehicle command channel.
+ *
+ * The radio thread opens a short receive window on the RN2483 every
+ * CONFIG_JOSH_UPLINK_PERIOD_MS, between transmissions, and hands the
+ * device to stm32_uplink_receive(). The window is bounded by the module's
+ * radio watchdog, which the radio thread shortens with stm32_rn2483_wdt()
+ * for receiving and restores before each transmission.
+ *
+ * An uplink frame is:
+ *
+ *   counter (4, LE) | command (1) | arguments (0-32) | tag (12)
+ *
+ * The tag is HMAC-SHA256 over everything before it, truncated to 96 bits.
+ * The counter must increase from frame to frame so a recorded frame cannot
+ * be replayed. The last accepted counter is kept in the EEPROM config store,
+ * so this holds across resets; the ground station starts counting at 1.
+ * Accepted commands are published on /dev/uorb/josh_uplink0 as struct
+ * josh_uplink_cmd_s.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <crypto/hmac.h>
+
+#include <nuttx/fs/fs.h>
+#include <nuttx/sensors/sensor.h>
+#include <arch/board/board.h>
+
+#include "josh.h"
+
+#ifdef CONFIG_JOSH_UPLINK
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define UPLINK_TOPIC       "/dev/uorb/josh_uplink0"
+#define UPLINK_KEY         CONFIG_JOSH_UPLINK_KEY
+#define UPLINK_KEYMAX      32
+
+#define UPLINK_HDRLEN      5   /* Counter and command */
+#define UPLINK_TAGLEN      12
+#define UPLINK_MINLEN      (UPLINK_HDRLEN + UPLINK_TAGLEN)
+#define UPLINK_MAXLEN      (UPLINK_MINLEN + JOSH_UPLINK_MAXARGS)
+
+/* Commands published but not yet read by anyone */
+
+#define UPLINK_NBUFFER     4
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct uplink_s
+{
+  struct sensor_lowerhalf_s lower;        /* uORB topic */
+  uint8_t key[UPLINK_KEYMAX];             /* HMAC key */
+  uint8_t keylen;
+  uint32_t counter;                       /* Last accepted counter */
+};
+
+/****************************************************************************
+ * Private Function Prototypes
+ ****************************************************************************/
+
+static int uplink_activate(FAR struct sensor_lowerhalf_s *lower,
+                           FAR struct file *filep, bool enable);
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const struct sensor_ops_s g_uplink_ops =
+{
+  .activate = uplink_activate,
+};
+
+static struct uplink_s g_uplink;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: uplink_activate
+ *
+ * Description:
+ *   Commands are event driven; there is nothing to switch on.
+ *
+ ****************************************************************************/
+
+static int uplink_activate(FAR struct sensor_lowerhalf_s *lower,
+                           FAR struct file *filep, bool enable)
+{
+  return OK;
+}
+
+/****************************************************************************
+ * Name: uplink_hexval
+ ****************************************************************************/
+
+static int uplink_hexval(char c)
+{
+  if (c >= '0' && c <= '9')
+    {
+      return c - '0';
+    }
+
+  c |= 0x20;
+  return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+/****************************************************************************
+ * Name: uplink_parsekey
+ ****************************************************************************/
+
+static int uplink_parsekey(FAR struct uplink_s *uplink, FAR const char *hex)
+{
+  size_t len = strlen(hex);
+  int hi;
+  int lo;
+  int i;
+
+  if (len == 0 || len % 2 != 0 || len / 2 > UPLINK_KEYMAX)
+    {
+      return -EINVAL;
+    }
+
+  for (i = 0; i < len / 2; i++)
+    {
+      hi = uplink_hexval(hex[2 * i]);
+      lo = uplink_hexval(hex[2 * i + 1]);
+      if (hi < 0 || lo < 0)
+        {
+          return -EINVAL;
+        }
+
+      uplink->key[i] = (hi << 4) | lo;
+    }
+
+  uplink->keylen = len / 2;
+  return OK;
+}
+
+/****************************************************************************
+ * Name: uplink_verify
+ *
+ * Description:
+ *   Check the truncated HMAC without an early exit, so the time taken does
+ *   not reveal how much of the tag matched.
+ *
+ ****************************************************************************/
+
+static bool uplink_verify(FAR struct uplink_s *uplink,
+                          FAR const uint8_t *frame, size_t len)
+{
+  HMAC_SHA256_CTX ctx;
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  uint8_t diff = 0;
+  int i;
+
+  HMAC_SHA256_Init(&ctx, uplink->key, uplink->keylen);
+  HMAC_SHA256_Update(&ctx, frame, len - UPLINK_TAGLEN);
+  HMAC_SHA256_Final(digest, &ctx);
+
+  for (i = 0; i < UPLINK_TAGLEN; i++)
+    {
+      diff |= digest[i] ^ frame[len - UPLINK_TAGLEN + i];
+    }
+
+  return diff == 0;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: stm32_uplink_initialize
+ *
+ * Description:
+ *   Load the uplink key and register the command topic. Called by the
+ *   radio thread, which opens no receive windows if this fails.
+ *
+ ****************************************************************************/
+
+int stm32_uplink_initialize(void)
+{
+  FAR struct uplink_s *uplink = &g_uplink;
+  int ret;
+
+  ret = uplink_parsekey(uplink, UPLINK_KEY);
+  if (ret < 0)
+    {
+      wlerr("ERROR: CONFIG_JOSH_UPLINK_KEY is not a valid hex key\n");
+      return ret;
+    }
+
+  /* An erased store reads as all ones; start from zero */
+
+  ret = stm32_eeconfig_read(JOSH_CONFIG_UPLINK_COUNTER, &uplink->counter,
+                            sizeof(uplink->counter));
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  if (uplink->counter == UINT32_MAX)
+    {
+      uplink->counter = 0;
+    }
+
+  uplink->lower.ops     = &g_uplink_ops;
+  uplink->lower.nbuffer = UPLINK_NBUFFER;
+
+  ret = sensor_custom_register(&uplink->lower, UPLINK_TOPIC,
+                               sizeof(struct josh_uplink_cmd_s));
+  if (ret < 0)
+    {
+      wlerr("ERROR: Failed to register %s: %d\n", UPLINK_TOPIC, ret);
+    }
+
+  return ret;
+}
+
+/****************************************************************************
+ * Name: stm32_uplink_receive
+ *
+ * Description:
+ *   Listen for one uplink frame on the RN2483 and publish it if it is
+ *   authentic. Returns when a frame arrives or the module's receive
+ *   watchdog ends the window.
+ *
+ * Returned Value:
+ *   OK if a command was published, -ETIMEDOUT if nothing was received, or
+ *   another negated errno if a frame was received and rejected.
+ *
+ ****************************************************************************/
+
+int stm32_uplink_receive(FAR struct file *dev)
+{
+  FAR struct uplink_s *uplink = &g_uplink;
+  struct josh_uplink_cmd_s cmd;
+  uint8_t frame[UPLINK_MAXLEN];
+  uint32_t counter;
+  ssize_t len;
+  ssize_t ret;
+
+  len = file_read(dev, frame, sizeof(frame));
+  if (len <= 0)
+    {
+      /* The driver reports the watchdog expiring as an error */
+
+      return -ETIMEDOUT;
+    }
+
+  if (len < UPLINK_MINLEN)
+    {
+      return -EBADMSG;
+    }
+
+  if (!uplink_verify(uplink, frame, len))
+    {
+      wlwarn("WARNING: Uplink frame failed authentication\n");
+      return -EACCES;
+    }
+
+  counter = frame[0] | (frame[1] << 8) | (frame[2] << 16) |
+            ((uint32_t)frame[3] << 24);
+
+  if (counter <= uplink->counter)
+    {
+      wlwarn("WARNING: Uplink frame %" PRIu32 " replayed\n", counter);
+      return -EALREADY;
+    }
+
+  /* Persist the counter before the command is acted on, and write it out
+   * at once rather than after the usual coalescing delay.
+   */
+
+  uplink->counter = counter;
+  stm32_eeconfig_write(JOSH_CONFIG_UPLINK_COUNTER, &counter,
+                       sizeof(counter));
+  stm32_eeconfig_commit();
+
+  memset(&cmd, 0, sizeof(cmd));
+  cmd.timestamp = sensor_get_timestamp();
+  cmd.counter   = counter;
+  cmd.cmd       = frame[4];
+  cmd.len       = len - UPLINK_MINLEN;
+  memcpy(cmd.args, &frame[UPLINK_HDRLEN], cmd.len);
+
+  ret = uplink->lower.push_event(uplink->lower.priv, &cmd, sizeof(cmd));
+  return ret < 0 ? ret : OK;
+}
+
+#endif /* CONFIG_JOSH_UPLINK */
@@ -27,20 +27,33 @@
 #include <sys/types.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <inttypes.h>
 #include <sched.h>
 #include <errno.h>
 #include <assert.h>
 #include <debug.h>
+#include <malloc.h>
+#include <syslog.h>
 
+#include <nuttx/irq.h>
+#include <nuttx/clock.h>
+#include <nuttx/kmalloc.h>
 #include <nuttx/kthread.h>
+#include <nuttx/wqueue.h>
+#include <nuttx/fs/fs.h>
 #include <nuttx/usb/usbdev.h>
 #include <nuttx/usb/usbhost.h>
 #include <nuttx/usb/usbdev_trace.h>
+#include <arch/board/board.h>
 
 #include "arm_internal.h"
 #include "chip.h"
+#include "nvic.h"
+#include "dwt.h"
 #include "stm32_gpio.h"
 #include "stm32_otg.h"
+#include "stm32_rcc.h"
+#include "hardware/stm32_tim.h"
 #include "josh.h"
 
 #ifdef CONFIG_STM32H7_OTGFS
@@ -56,12 +69,76 @@
 #  undef HAVE_USB
 #endif
 
-#ifndef CONFIG_JOSH_USBHOST_PRIO
-#  define CONFIG_JOSH_USBHOST_PRIO 100
+#ifdef CONFIG_USBHOST
+#  ifndef CONFIG_SCHED_LPWORK
+#    error "USB host connection handling requires CONFIG_SCHED_LPWORK"
+#  endif
+#  ifndef CONFIG_IRQCHAIN
+#    error "USB host connection handling requires CONFIG_IRQCHAIN"
+#  endif
+
+/* The mass storage class registers its block driver after enumeration
+ * returns; give it this many tries, this far apart, to appear.
+ */
+
+#  define USBHOST_MOUNT_TRIES 25
+#  define USBHOST_MOUNT_DELAY MSEC2TICK(200)
+#endif
+
+#ifdef CONFIG_JOSH_USBPM
+/* While suspended the CPU runs at half speed. The AHB prescaler drops from
+ * /2 to /1 at the same time, so HCLK and every bus and kernel clock below
+ * it are unchanged and no driver notices.
+ */
+
+#  define USBPM_D1CFGR_MASK   (RCC_D1CFGR_D1CPRE_MASK | RCC_D1CFGR_HPRE_MASK)
+#  define USBPM_D1CFGR_RUN    (STM32_RCC_D1CFGR_D1CPRE | STM32_RCC_D1CFGR_HPRE)
+#  define USBPM_D1CFGR_SLOW   (RCC_D1CFGR_D1CPRE_SYSCLKd2 | \
+                               RCC_D1CFGR_HPRE_SYSCLK)
+#  define USBPM_CPUCLK_SLOW   (STM32_CPUCLK_FREQUENCY / 2)
+
+#  if STM32_RCC_D1CFGR_D1CPRE != RCC_D1CFGR_D1CPRE_SYSCLK || \
+      STM32_RCC_D1CFGR_HPRE != RCC_D1CFGR_HPRE_SYSCLKd2
+#    error "CONFIG_JOSH_USBPM assumes CPUCLK = SYSCLK and HCLK = SYSCLK / 2"
+#  endif
+
+/* The buzzer timer is gated while suspended if no tone is playing; the
+ * tone sequencer turns its clock back on before it plays. ADC2 and its
+ * TIM2 trigger keep running, so the battery and pyro continuity watchdogs
+ * stay live on the pad.
+ */
+
+#  define USBPM_APB2_GATE     RCC_APB2ENR_TIM1EN
+#  define USBPM_TIM1_CR1      (STM32_TIM1_BASE + STM32_ATIM_CR1_OFFSET)
+#endif
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+#ifdef CONFIG_USBHOST
+struct usbhost_state_s
+{
+  struct work_s work;                     /* Connection change */
+  struct work_s mount;                    /* Drive mount retries */
+  FAR struct usbhost_connection_s *conn;  /* Root hub connection */
+  FAR struct usbhost_hubport_s *hport;    /* Root hub port */
+  volatile bool connected;                /* Last port state handled */
+  volatile bool enumerated;               /* A class driver is bound */
+  bool mounted;                           /* Drive is mounted */
+  int tries;                              /* Mount attempts left */
+  clock_t connect_time;                   /* Port connect seen */
+  clock_t enum_time;                      /* Enumeration finished */
+  size_t heap_before;                     /* Heap in use at connect */
+};
 #endif
 
-#ifndef CONFIG_JOSH_USBHOST_STACKSIZE
-#  define CONFIG_JOSH_USBHOST_STACKSIZE 1024
+#ifdef CONFIG_JOSH_USBPM
+struct usbpm_state_s
+{
+  struct josh_usbpm_stats_s stats;        /* Reported by BIOC_USBPM_STATS */
+  uint32_t apb2enr;                       /* Clocks gated at suspend */
+};
 #endif
 
 /****************************************************************************
@@ -69,7 +146,11 @@
  ****************************************************************************/
 
 #ifdef CONFIG_USBHOST
-static struct usbhost_connection_s *g_usbconn;
+static struct usbhost_state_s g_usbhost;
+#endif
+
+#ifdef CONFIG_JOSH_USBPM
+static struct usbpm_state_s g_usbpm;
 #endif
 
 /****************************************************************************
@@ -77,39 +158,318 @@ static struct usbhost_connection_s *g_usbconn;
  ****************************************************************************/
 
 /****************************************************************************
- * Name: usbhost_waiter
+ * Name: usbhost_heapused
+ ****************************************************************************/
+
+#ifdef CONFIG_USBHOST
+static size_t usbhost_heapused(void)
+{
+  struct mallinfo mem = kmm_mallinfo();
+
+  return mem.uordblks;
+}
+#endif
+
+/****************************************************************************
+ * Name: usbhost_mount
  *
  * Description:
- *   Wait for USB devices to be connected.
+ *   Mount a thumb drive once the mass storage class has registered it, and
+ *   report how long the connection took and the memory it costs. The
+ *   block driver appears only after enumeration returns, so a failed
+ *   attempt requeues itself rather than sleeping on the work queue.
  *
  ****************************************************************************/
 
+#ifdef CONFIG_USBHOST_MSC
+static void usbhost_mount(FAR void *arg)
+{
+  FAR struct usbhost_state_s *host = (FAR struct usbhost_state_s *)arg;
+  int ret;
+
+  if (!host->enumerated)
+    {
+      return;
+    }
+
+  ret = nx_mount("/dev/sda", CONFIG_JOSH_USBHOST_MOUNTPOINT, "vfat", 0,
+                 NULL);
+  if (ret < 0)
+    {
+      if (--host->tries == 0)
+        {
+          syslog(LOG_ERR, "Failed to mount USB drive: %d\n", ret);
+        }
+      else
+        {
+          work_queue(LPWORK, &host->mount, usbhost_mount, host,
+                     USBHOST_MOUNT_DELAY);
+        }
+
+      return;
+    }
+
+  host->mounted = true;
+
+  syslog(LOG_INFO, "USB drive at %s: enumerated in %u ms, mounted in "
+         "%u ms, %zu bytes of heap\n", CONFIG_JOSH_USBHOST_MOUNTPOINT,
+         (unsigned int)TICK2MSEC(host->enum_time - host->connect_time),
+         (unsigned int)TICK2MSEC(clock_systime_ticks() -
+                                 host->connect_time),
+         usbhost_heapused() - host->heap_before);
+}
+#endif
+
+/****************************************************************************
+ * Name: usbhost_changed
+ ****************************************************************************/
+
 #ifdef CONFIG_USBHOST
-static int usbhost_waiter(int argc, char *argv[])
+static bool usbhost_changed(FAR struct usbhost_state_s *host)
 {
-  struct usbhost_hubport_s *hport;
+  bool connected = (getreg32(STM32_OTG_HPRT) & OTG_HPRT_PCSTS) != 0;
 
-  uinfo("Running\n");
-  for (; ; )
+  /* A device pulled and plugged back in before the work ran leaves the
+   * port connected, but the driver unbinds its class driver on the
+   * disconnect, so a bound device losing its class is a change too.
+   */
+
+  return connected != host->connected ||
+         (host->enumerated && host->hport->devclass == NULL);
+}
+#endif
+
+/****************************************************************************
+ * Name: usbhost_worker
+ *
+ * Description:
+ *   Handle a port change reported by the OTG interrupt: collect it from the
+ *   driver, unmount whatever was attached before and enumerate a new
+ *   device. Enumeration holds the low priority work queue for as long as
+ *   the device takes to answer its control requests.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_USBHOST
+static void usbhost_worker(FAR void *arg)
+{
+  FAR struct usbhost_state_s *host = (FAR struct usbhost_state_s *)arg;
+  int ret;
+
+  /* The interrupt may have fired for a change that has since reverted.
+   * Otherwise the driver has the change latched and this returns at once.
+   */
+
+  if (!usbhost_changed(host))
     {
-      /* Wait for the device to change state */
+      return;
+    }
 
-      DEBUGVERIFY(CONN_WAIT(g_usbconn, &hport));
-      uinfo("%s\n", hport->connected ? "connected" : "disconnected");
+  DEBUGVERIFY(CONN_WAIT(host->conn, &host->hport));
+  uinfo("%s\n", host->hport->connected ? "connected" : "disconnected");
 
-      /* Did we just become connected? */
+  host->connected  = host->hport->connected;
+  host->enumerated = false;
 
-      if (hport->connected)
-        {
-          /* Yes.. enumerate the newly connected device */
+#ifdef CONFIG_USBHOST_MSC
+  work_cancel(LPWORK, &host->mount);
+  if (host->mounted)
+    {
+      nx_umount2(CONFIG_JOSH_USBHOST_MOUNTPOINT, MNT_DETACH);
+      host->mounted = false;
+    }
+#endif
 
-          CONN_ENUMERATE(g_usbconn, hport);
-        }
+  if (!host->connected)
+    {
+      return;
+    }
+
+  host->connect_time = clock_systime_ticks();
+  host->heap_before  = usbhost_heapused();
+
+  ret = CONN_ENUMERATE(host->conn, host->hport);
+  host->enum_time = clock_systime_ticks();
+  if (ret < 0)
+    {
+      uerr("ERROR: Enumeration failed: %d\n", ret);
+      return;
+    }
+
+  host->enumerated = true;
+  uinfo("Enumerated in %u ms\n",
+        (unsigned int)TICK2MSEC(host->enum_time - host->connect_time));
+
+#ifdef CONFIG_USBHOST_MSC
+  host->tries = USBHOST_MOUNT_TRIES;
+  usbhost_mount(host);
+#endif
+}
+#endif
+
+/****************************************************************************
+ * Name: usbhost_interrupt
+ *
+ * Description:
+ *   Chained onto the OTG FS interrupt after the host driver's own handler,
+ *   which has already acknowledged the port and disconnect interrupts and
+ *   latched the change. Compare the port state with the last one handled
+ *   and queue the worker on a difference. The port raises no interrupt
+ *   while it is empty, so nothing runs until a device is plugged in.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_USBHOST
+static int usbhost_interrupt(int irq, FAR void *context, FAR void *arg)
+{
+  FAR struct usbhost_state_s *host = (FAR struct usbhost_state_s *)arg;
+
+  if (usbhost_changed(host) && work_available(&host->work))
+    {
+      work_queue(LPWORK, &host->work, usbhost_worker, host, 0);
+    }
+
+  return OK;
+}
+#endif
+
+/****************************************************************************
+ * Name: usbpm_cycles_to_ns
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_USBPM
+static inline uint32_t usbpm_cycles_to_ns(uint32_t cycles, uint32_t hz)
+{
+  return (uint32_t)((uint64_t)cycles * NSEC_PER_SEC / hz);
+}
+#endif
+
+/****************************************************************************
+ * Name: usbpm_setclock
+ *
+ * Description:
+ *   Switch the CPU between full and half speed, keeping the system tick at
+ *   CLK_TCK. Busy-wait delays run long while slowed, never short.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_USBPM
+static void usbpm_setclock(uint32_t d1cfgr, uint32_t cpuclk)
+{
+  modifyreg32(STM32_RCC_D1CFGR, USBPM_D1CFGR_MASK, d1cfgr);
+
+#ifndef CONFIG_SCHED_TICKLESS
+  putreg32(cpuclk / CLK_TCK - 1, NVIC_SYSTICK_RELOAD);
+#endif
+}
+#endif
+
+/****************************************************************************
+ * Name: usbpm_suspend
+ *
+ * Description:
+ *   Gate the buzzer timer if it is stopped, then slow the CPU. Called from
+ *   the OTG interrupt.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_USBPM
+static void usbpm_suspend(FAR struct usbpm_state_s *pm)
+{
+  uint32_t start;
+  uint32_t gated;
+  uint32_t end;
+
+  /* The DWT counter may not have been started by the perf code */
+
+  modifyreg32(NVIC_DEMCR, 0, NVIC_DEMCR_TRCENA);
+  modifyreg32(DWT_CTRL, 0, DWT_CTRL_CYCCNTENA_MASK);
+
+  start = getreg32(DWT_CYCCNT);
+
+  /* Remember whether the clock was on so resume turns it on only then */
+
+  pm->apb2enr = getreg32(STM32_RCC_APB2ENR) & USBPM_APB2_GATE;
+  if ((getreg32(USBPM_TIM1_CR1) & ATIM_CR1_CEN) != 0)
+    {
+      pm->apb2enr = 0;
     }
 
-  /* Keep the compiler from complaining */
+  modifyreg32(STM32_RCC_APB2ENR, pm->apb2enr, 0);
 
-  return 0;
+  gated = getreg32(DWT_CYCCNT);
+  usbpm_setclock(USBPM_D1CFGR_SLOW, USBPM_CPUCLK_SLOW);
+  end = getreg32(DWT_CYCCNT);
+
+  pm->stats.suspended  = true;
+  pm->stats.suspend_ns =
+    usbpm_cycles_to_ns(gated - start, STM32_CPUCLK_FREQUENCY) +
+    usbpm_cycles_to_ns(end - gated, USBPM_CPUCLK_SLOW);
+  pm->stats.suspends++;
+}
+#endif
+
+/****************************************************************************
+ * Name: usbpm_resume
+ *
+ * Description:
+ *   Restore full speed first, then the gated clock.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_USBPM
+static void usbpm_resume(FAR struct usbpm_state_s *pm)
+{
+  uint32_t start;
+  uint32_t fast;
+  uint32_t end;
+
+  start = getreg32(DWT_CYCCNT);
+  usbpm_setclock(USBPM_D1CFGR_RUN, STM32_CPUCLK_FREQUENCY);
+  fast = getreg32(DWT_CYCCNT);
+
+  modifyreg32(STM32_RCC_APB2ENR, 0, pm->apb2enr);
+
+  end = getreg32(DWT_CYCCNT);
+
+  pm->stats.suspended = false;
+  pm->stats.resume_ns =
+    usbpm_cycles_to_ns(fast - start, USBPM_CPUCLK_SLOW) +
+    usbpm_cycles_to_ns(end - fast, STM32_CPUCLK_FREQUENCY);
+  if (pm->stats.resume_ns > pm->stats.max_resume_ns)
+    {
+      pm->stats.max_resume_ns = pm->stats.resume_ns;
+    }
+
+  pm->stats.resumes++;
+}
+#endif
+
+/****************************************************************************
+ * Name: usbpm_interrupt
+ *
+ * Description:
+ *   Chained onto the OTG FS interrupt after the device driver's handler.
+ *   The driver only reports a resume signalled by the host, so a bus reset
+ *   from the suspended state would leave the board slowed. Any OTG
+ *   interrupt taken while the core no longer reports the bus suspended
+ *   resumes the board. Nothing runs while the bus stays suspended.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_USBPM
+static int usbpm_interrupt(int irq, FAR void *context, FAR void *arg)
+{
+  FAR struct usbpm_state_s *pm = (FAR struct usbpm_state_s *)arg;
+
+  if (pm->stats.suspended &&
+      (getreg32(STM32_OTG_DSTS) & OTG_DSTS_SUSPSTS) == 0)
+    {
+      usbpm_resume(pm);
+      uinfo("Woke in %" PRIu32 " ns\n", pm->stats.resume_ns);
+    }
+
+  return OK;
 }
 #endif
 
@@ -123,8 +483,10 @@ static int usbhost_waiter(int argc, char *argv[])
  * Description:
  *   Called at application startup time to initialize the USB host
  *   functionality.
- *   This function will start a thread that will monitor for device
- *   connection/disconnection events.
+ *   Device connection and disconnection are signalled by the OTG FS
+ *   interrupt and handled on the low priority work queue. With
+ *   CONFIG_USBHOST_MSC a thumb drive is mounted at
+ *   CONFIG_JOSH_USBHOST_MOUNTPOINT.
  *
  ****************************************************************************/
 
@@ -192,20 +554,23 @@ int stm32_usbhost_initialize(void)
   /* Then get an instance of the USB host interface */
 
   uinfo("Initialize USB host\n");
-  g_usbconn = stm32_otgfshost_initialize(0);
-  if (g_usbconn)
+  g_usbhost.conn = stm32_otgfshost_initialize(0);
+  if (g_usbhost.conn == NULL)
     {
-      /* Start a thread to handle device connection. */
+      return -ENODEV;
+    }
 
-      uinfo("Start usbhost_waiter\n");
+  /* Watch for device connection behind the driver's own handler, then
+   * pick up a device that was plugged in before we were attached.
+   */
 
-      ret = kthread_create("usbhost", CONFIG_JOSH_USBHOST_PRIO,
-                           CONFIG_JOSH_USBHOST_STACKSIZE,
-                           usbhost_waiter, NULL);
-      return ret < 0 ? -ENOEXEC : OK;
+  ret = irq_attach(STM32_IRQ_OTGFS, usbhost_interrupt, &g_usbhost);
+  if (ret < 0)
+    {
+      return ret;
     }
 
-  return -ENODEV;
+  return work_queue(LPWORK, &g_usbhost.work, usbhost_worker, &g_usbhost, 0);
 }
 #endif
 
@@ -243,9 +608,11 @@ void stm32_usbhost_vbusdrive(int iface, bool enable)
 {
   DEBUGASSERT(iface == 0);
 
+#ifdef GPIO_OTGFS_PWRON
   /* Set the Power Switch by driving the active high enable pin */
 
   stm32_gpiowrite(GPIO_OTGFS_PWRON, enable);
+#endif
 }
 #endif
 
@@ -269,7 +636,13 @@ void stm32_usbhost_vbusdrive(int iface, bool enable)
 #ifdef CONFIG_USBHOST
 int stm32_setup_overcurrent(xcpt_t handler, void *arg)
 {
+#ifdef GPIO_OTGFS_OVER
   return stm32_gpiosetevent(GPIO_OTGFS_OVER, true, true, true, handler, arg);
+#else
+  /* Josh has no VBUS switch, so no overcurrent sense either */
+
+  return -ENOSYS;
+#endif
 }
 #endif
 
@@ -287,7 +660,94 @@ int stm32_setup_overcurrent(xcpt_t handler, void *arg)
 #ifdef CONFIG_USBDEV
 void stm32_usbsuspend(struct usbdev_s *dev, bool resume)
 {
+#ifdef CONFIG_JOSH_USBPM
+  FAR struct usbpm_state_s *pm = &g_usbpm;
+
+  /* The core can report suspend more than once; only act on changes */
+
+  if (resume && pm->stats.suspended)
+    {
+      usbpm_resume(pm);
+      uinfo("Resumed in %" PRIu32 " ns\n", pm->stats.resume_ns);
+    }
+  else if (!resume && !pm->stats.suspended)
+    {
+      usbpm_suspend(pm);
+      uinfo("Suspended in %" PRIu32 " ns\n", pm->stats.suspend_ns);
+    }
+#else
   uinfo("resume: %d\n", resume);
+#endif
+}
+#endif
+
+/****************************************************************************
+ * Name: stm32_usbpm_initialize
+ *
+ * Description:
+ *   Chain the bus reset wakeup onto the OTG FS interrupt, which the device
+ *   driver has attached by the time the board is brought up.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_USBPM
+int stm32_usbpm_initialize(void)
+{
+  return irq_attach(STM32_IRQ_OTGFS, usbpm_interrupt, &g_usbpm);
+}
+#endif
+
+/****************************************************************************
+ * Name: stm32_usbpm_resume
+ *
+ * Description:
+ *   Leave the low power state without waiting for the host. Without VBUS
+ *   sensing a pulled cable looks like a suspend, so flight software calls
+ *   this before arming. Also called from the umbilical detect interrupt.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_USBPM
+int stm32_usbpm_resume(void)
+{
+  irqstate_t flags;
+
+  flags = enter_critical_section();
+  if (g_usbpm.stats.suspended)
+    {
+      usbpm_resume(&g_usbpm);
+    }
+
+  leave_critical_section(flags);
+  return OK;
+}
+#endif
+
+/****************************************************************************
+ * Name: stm32_usbpm_stats
+ *
+ * Description:
+ *   Report USB suspend state and how long the last transitions took.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_JOSH_USBPM
+int stm32_usbpm_stats(FAR struct josh_usbpm_stats_s *stats)
+{
+  irqstate_t flags;
+
+  if (stats == NULL)
+    {
+      return -EINVAL;
+    }
+
+  /* Updated from the OTG interrupt */
+
+  flags  = enter_critical_section();
+  *stats = g_usbpm.stats;
+  leave_critical_section(flags);
+
+  return OK;
 }
 #endif
 
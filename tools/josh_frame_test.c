@@ -0,0 +1,224 @@
+/****************************************************************************
+ * tools/josh_frame_test.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/* Host check of the radio downlink framing in src/josh_frame.c.
+ *
+ *   cc -O2 -Wall -I src -o josh_frame_test tools/josh_frame_test.c \
+ *      src/josh_frame.c
+ *   ./josh_frame_test [iterations] [seed]
+ *
+ * Every iteration picks a random configuration and payload, encodes a
+ * frame and decodes it three ways:
+ *
+ *   - untouched, which must decode with no corrections;
+ *   - with a burst of errors the interleave guarantees to correct, which
+ *     must restore the payload exactly;
+ *   - with every byte damaged, where rejected and miscorrected frames are
+ *     counted and reported.
+ *
+ * Exits non-zero on the first failure.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "josh_frame.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define TEST_ITERATIONS  10000
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static int fail(unsigned long iter, const struct josh_frame_cfg_s *cfg,
+                size_t len, const char *what, int ret)
+{
+  fprintf(stderr, "FAIL iteration %lu nroots %u depth %u len %zu: %s "
+          "(%d)\n", iter, cfg->nroots, cfg->depth, len, what, ret);
+  return EXIT_FAILURE;
+}
+
+/* Decode 'frame' and compare it against the payload that was sent */
+
+static int check(const struct josh_frame_cfg_s *cfg, uint8_t *frame,
+                 int framelen, uint16_t seq, const uint8_t *payload,
+                 size_t len)
+{
+  const uint8_t *rxpayload;
+  uint16_t rxseq;
+  size_t rxlen;
+  int ret;
+
+  ret = josh_frame_decode(cfg, frame, framelen, &rxseq, &rxpayload,
+                          &rxlen);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  if (rxseq != seq || rxlen != len || memcmp(rxpayload, payload, len))
+    {
+      return -EILSEQ;
+    }
+
+  return ret;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+  unsigned long iterations = TEST_ITERATIONS;
+  unsigned long detected = 0;
+  unsigned long miscorrected = 0;
+  unsigned long iter;
+  struct josh_frame_cfg_s cfg;
+  uint8_t payload[JOSH_FRAME_MAXLEN];
+  uint8_t frame[JOSH_FRAME_MAXLEN];
+  uint8_t sent[JOSH_FRAME_MAXLEN];
+  uint16_t seq;
+  size_t maxlen;
+  size_t len;
+  int framelen;
+  int burst;
+  int start;
+  int ret;
+  int i;
+
+  if (argc > 1)
+    {
+      iterations = strtoul(argv[1], NULL, 0);
+    }
+
+  srand(argc > 2 ? strtoul(argv[2], NULL, 0) : 1);
+
+  for (iter = 0; iter < iterations; iter++)
+    {
+      /* A configuration that leaves room for at least one payload byte */
+
+      do
+        {
+          cfg.nroots = 2 * (1 + rand() % 32);
+          cfg.depth  = 1 + rand() % JOSH_FRAME_MAXDEPTH;
+        }
+      while (JOSH_FRAME_OVERHEAD(cfg.nroots, cfg.depth) >=
+             JOSH_FRAME_MAXLEN);
+
+      maxlen = JOSH_FRAME_MAXLEN - JOSH_FRAME_OVERHEAD(cfg.nroots,
+                                                       cfg.depth);
+      len = 1 + rand() % maxlen;
+      seq = rand();
+
+      for (i = 0; i < (int)len; i++)
+        {
+          payload[i] = rand();
+        }
+
+      framelen = josh_frame_encode(&cfg, seq, payload, len, sent,
+                                   sizeof(sent));
+      if (framelen < 0)
+        {
+          if (framelen == -EMSGSIZE)
+            {
+              /* A shortened code would be longer than 255 bytes */
+
+              continue;
+            }
+
+          return fail(iter, &cfg, len, "encode", framelen);
+        }
+
+      if ((size_t)framelen != len + JOSH_FRAME_OVERHEAD(cfg.nroots,
+                                                        cfg.depth))
+        {
+          return fail(iter, &cfg, len, "frame length", framelen);
+        }
+
+      /* Clean frame */
+
+      memcpy(frame, sent, framelen);
+      ret = check(&cfg, frame, framelen, seq, payload, len);
+      if (ret != 0)
+        {
+          return fail(iter, &cfg, len, "clean frame", ret);
+        }
+
+      /* A burst of up to depth * nroots / 2 bytes puts at most nroots / 2
+       * errors in each code, which must all be corrected.
+       */
+
+      burst = 1 + rand() % (cfg.depth * cfg.nroots / 2);
+      if (burst > framelen)
+        {
+          burst = framelen;
+        }
+
+      start = rand() % (framelen - burst + 1);
+
+      memcpy(frame, sent, framelen);
+      for (i = start; i < start + burst; i++)
+        {
+          frame[i] ^= 1 + rand() % 255;
+        }
+
+      ret = check(&cfg, frame, framelen, seq, payload, len);
+      if (ret < 0 || ret > burst)
+        {
+          return fail(iter, &cfg, len, "correctable burst", ret);
+        }
+
+      /* Every byte of the frame damaged, far beyond what any code can
+       * correct. Reed-Solomon may still land on another valid codeword
+       * now and then; count how often each outcome happens.
+       */
+
+      memcpy(frame, sent, framelen);
+      for (i = 0; i < framelen; i++)
+        {
+          frame[i] ^= 1 + rand() % 255;
+        }
+
+      ret = check(&cfg, frame, framelen, seq, payload, len);
+      if (ret == -EILSEQ)
+        {
+          miscorrected++;
+        }
+      else if (ret < 0)
+        {
+          detected++;
+        }
+    }
+
+  printf("%lu iterations passed; garbled frames: %lu rejected, "
+         "%lu miscorrected\n", iterations, detected, miscorrected);
+  return EXIT_SUCCESS;
+}
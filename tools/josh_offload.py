@@ -0,0 +1,333 @@
+#!/usr/bin/env python3
+#
+# tools/josh_offload.py
+#
+# Licensed to the Apache Software Foundation (ASF) under one or more
+# contributor license agreements.  See the NOTICE file distributed with
+# this work for additional information regarding copyright ownership.  The
+# ASF licenses this file to you under the Apache License, Version 2.0 (the
+# "License"); you may not use this file except in compliance with the
+# License.  You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+# WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+# License for the specific language governing permissions and limitations
+# under the License.
+
+"""Pull files off the Josh flight computer over USB.
+
+Talks to the board's offload service (src/stm32_offload.c, enabled with
+CONFIG_JOSH_OFFLOAD) on its CDC-ACM port. Needs only the Python standard
+library on Linux.
+
+    josh_offload.py [-d /dev/ttyACM0] ls /mnt/pwrfs
+    josh_offload.py [-d /dev/ttyACM0] get /mnt/pwrfs/flight.bin [local]
+    josh_offload.py [-d /dev/ttyACM1] stream [-o out.bin] accel gyro
+
+'get' resumes into an existing local file, so an interrupted transfer can be
+restarted with the same command.
+
+'stream' needs CONFIG_JOSH_OFFLOAD_STREAM. It prints sample rates per topic
+and can record the raw samples: each record in the output file is the
+topic index (1 byte), the payload length (2 bytes, LE) and the samples as
+the board's uORB structs.
+"""
+
+import argparse
+import os
+import select
+import struct
+import sys
+import termios
+import time
+import tty
+
+SYNC = b"JO"
+HDRLEN = 6
+CRCLEN = 4
+
+LIST, GET, ACK, NAK, ABORT, STREAM = 0x01, 0x02, 0x03, 0x04, 0x05, 0x06
+OK, ENTRY, DATA, END, TELEM, ERROR = 0x80, 0x81, 0x82, 0x83, 0x84, 0xFF
+
+# Topics the board can stream, in the order of its topic index
+
+TOPICS = ["accel", "gyro", "mag", "baro", "gnss", "volt", "current"]
+
+TIMEOUT = 2.0
+
+
+def _crc_table():
+    table = []
+    for n in range(256):
+        c = n
+        for _ in range(8):
+            c = (c >> 1) ^ 0xEDB88320 if c & 1 else c >> 1
+        table.append(c)
+    return table
+
+
+CRC_TABLE = _crc_table()
+
+
+def crc32(data):
+    """NuttX crc32(): reflected 0xedb88320, initial value 0, no inversion."""
+    crc = 0
+    for b in data:
+        crc = CRC_TABLE[(crc ^ b) & 0xFF] ^ (crc >> 8)
+    return crc
+
+
+class Link:
+    def __init__(self, path):
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+        tty.setraw(self.fd)
+        termios.tcflush(self.fd, termios.TCIOFLUSH)
+        self.buf = bytearray()
+
+    def close(self):
+        os.close(self.fd)
+
+    def send(self, ftype, payload=b""):
+        body = struct.pack("<BBH", ftype, 0, len(payload)) + payload
+        os.write(self.fd, SYNC + body + struct.pack("<I", crc32(body)))
+
+    def send32(self, ftype, value):
+        self.send(ftype, struct.pack("<I", value))
+
+    def recv(self, timeout=TIMEOUT):
+        """Return the next good (type, payload), or None on timeout."""
+        deadline = time.monotonic() + timeout
+        while True:
+            frame = self._parse()
+            if frame is not None:
+                return frame
+
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                return None
+
+            ready, _, _ = select.select([self.fd], [], [], remaining)
+            if ready:
+                self.buf += os.read(self.fd, 65536)
+
+    def _parse(self):
+        while True:
+            start = self.buf.find(SYNC)
+            if start < 0:
+                del self.buf[:-1]
+                return None
+
+            del self.buf[:start]
+            if len(self.buf) < HDRLEN:
+                return None
+
+            ftype, _, length = struct.unpack_from("<BBH", self.buf, 2)
+            total = HDRLEN + length + CRCLEN
+            if len(self.buf) < total:
+                return None
+
+            (crc,) = struct.unpack_from("<I", self.buf, HDRLEN + length)
+            if crc != crc32(self.buf[2:HDRLEN + length]):
+                del self.buf[:1]
+                continue
+
+            payload = bytes(self.buf[HDRLEN:HDRLEN + length])
+            del self.buf[:total]
+            return ftype, payload
+
+
+def check_error(frame):
+    if frame is None:
+        sys.exit("error: no answer from the board")
+
+    ftype, payload = frame
+    if ftype == ERROR:
+        (err,) = struct.unpack("<I", payload)
+        sys.exit("error: board returned %s" % os.strerror(err))
+
+
+def do_ls(link, path):
+    link.send(LIST, path.encode())
+    while True:
+        frame = link.recv()
+        check_error(frame)
+        ftype, payload = frame
+        if ftype == OK:
+            return
+
+        if ftype == ENTRY:
+            (size,) = struct.unpack_from("<I", payload)
+            name = payload[4:].decode(errors="replace")
+            if size == 0xFFFFFFFF:
+                print("%12s  %s/" % ("-", name))
+            else:
+                print("%12d  %s" % (size, name))
+
+
+def do_get(link, remote, local):
+    out = open(local, "ab")
+    offset = out.tell()
+
+    link.send(GET, struct.pack("<I", offset) + remote.encode())
+    while True:
+        frame = link.recv()
+        check_error(frame)
+        if frame[0] == OK:
+            break
+
+    (size,) = struct.unpack("<I", frame[1])
+    if offset:
+        print("resuming at %d of %d bytes" % (offset, size))
+
+    start = time.monotonic()
+    since_ack = 0
+    nak_sent = False
+    acked = offset
+
+    while True:
+        frame = link.recv()
+        if frame is None:
+            # The board goes back to the last ACK on its own, but make sure
+            # it knows where we are.
+
+            link.send32(NAK, offset)
+            continue
+
+        check_error(frame)
+        ftype, payload = frame
+
+        if ftype == END:
+            break
+
+        if ftype != DATA:
+            continue
+
+        (chunk_offset,) = struct.unpack_from("<I", payload)
+        data = payload[4:]
+        if chunk_offset != offset:
+            # Go-back-N: ask once for the missing data and drop everything
+            # until it arrives.
+
+            if not nak_sent and chunk_offset > offset:
+                link.send32(NAK, offset)
+                nak_sent = True
+            continue
+
+        out.write(data)
+        offset += len(data)
+        nak_sent = False
+        since_ack += 1
+
+        # ACK often enough that the board never stalls on a full window
+
+        if since_ack >= 4 or offset == size:
+            link.send32(ACK, offset)
+            since_ack = 0
+            acked = offset
+
+        if sys.stderr.isatty():
+            sys.stderr.write("\r%d/%d bytes" % (offset, size))
+
+    if acked != offset:
+        link.send32(ACK, offset)
+
+    out.close()
+    elapsed = time.monotonic() - start
+    if sys.stderr.isatty():
+        sys.stderr.write("\n")
+
+    print("%d bytes in %.1f s (%.0f kB/s)" %
+          (offset, elapsed, offset / 1000 / max(elapsed, 1e-3)))
+
+
+def do_stream(link, topics, output):
+    mask = 0
+    for name in topics or TOPICS:
+        mask |= 1 << TOPICS.index(name)
+
+    link.send(STREAM, bytes([mask]))
+    while True:
+        frame = link.recv()
+        check_error(frame)
+        if frame[0] == OK:
+            break
+
+    (opened,) = struct.unpack("<I", frame[1])
+    missing = [t for i, t in enumerate(TOPICS)
+               if mask & (1 << i) and not opened & (1 << i)]
+    if missing:
+        print("not available: %s" % " ".join(missing))
+
+    out = open(output, "ab") if output else None
+    counts = [0] * len(TOPICS)
+    last = time.monotonic()
+
+    try:
+        while True:
+            frame = link.recv(1.0)
+            if frame is not None and frame[0] == TELEM:
+                payload = frame[1]
+                counts[payload[0]] += len(payload) - 1
+                if out:
+                    out.write(struct.pack("<BH", payload[0],
+                                          len(payload) - 1) + payload[1:])
+
+            now = time.monotonic()
+            if now - last >= 1.0:
+                print("  ".join("%s %d B/s" % (TOPICS[i], counts[i] /
+                                               (now - last))
+                                for i in range(len(TOPICS))
+                                if opened & (1 << i)))
+                counts = [0] * len(TOPICS)
+                last = now
+    finally:
+        link.send(STREAM, b"\x00")
+        if out:
+            out.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-d", "--device", default="/dev/ttyACM0")
+    sub = parser.add_subparsers(dest="cmd", required=True)
+
+    ls = sub.add_parser("ls", help="list a directory on the board")
+    ls.add_argument("path")
+
+    get = sub.add_parser("get", help="copy a file from the board")
+    get.add_argument("remote")
+    get.add_argument("local", nargs="?")
+
+    stream = sub.add_parser("stream", help="stream live sensor topics")
+    stream.add_argument("-o", "--output", help="append samples to a file")
+    stream.add_argument("topics", nargs="*", metavar="topic",
+                        help="any of %s (default all)" % ", ".join(TOPICS))
+
+    args = parser.parse_args()
+    if args.cmd == "stream":
+        for name in args.topics:
+            if name not in TOPICS:
+                parser.error("unknown topic %s" % name)
+
+    link = Link(args.device)
+
+    try:
+        if args.cmd == "ls":
+            do_ls(link, args.path)
+        elif args.cmd == "stream":
+            do_stream(link, args.topics, args.output)
+        else:
+            do_get(link, args.remote,
+                   args.local or os.path.basename(args.remote))
+    except KeyboardInterrupt:
+        link.send(ABORT)
+        sys.exit(1)
+    finally:
+        link.close()
+
+
+if __name__ == "__main__":
+    main()